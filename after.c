@@ -0,0 +1,317 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "jobs.h"
+#include "wrappers.h"
+#include "after.h"
+#include "snapshot.h"
+#include "deadline.h"
+
+/* A job started by after is forked at once, so that it has a PID and a
+ * place in the job list like any other job, but it is Pending: the
+ * child blocks reading a pipe before it execs.  The reaping path calls
+ * after_reaped for every job that finishes, and once the last of a
+ * pending job's dependencies is gone the shell writes "r" to its pipe
+ * and the job starts running.  If a dependency fails and the job was
+ * registered with -s, the shell writes "x" instead and the child exits
+ * with status 1, which in turn fails the jobs that depend on it.
+ *
+ * A job can only depend on jobs that already exist, so dependencies can
+ * never form a cycle.
+ *
+ * The go pipes are close-on-exec, but a child that does not exec (a
+ * builtin run as a job, a list's shell) closes the ones it inherited
+ * itself (after_child), or a pending job would never see EOF.  A
+ * pending job's timeout= starts counting when it is released. */
+
+/* States of a pending entry */
+#define FREE    0
+#define WAITING 1 /* dependencies still running */
+#define READY   2 /* waiting for a slot under the concurrency limit */
+#define RUNNING 3 /* released, not yet reaped */
+#define ABORTED 4 /* told not to run, not yet reaped */
+
+typedef struct
+{
+    int state;
+    job_t *owner;          /* job list the job is in */
+    pid_t pid;             /* the pending job */
+    int fd;                /* write end of its go pipe */
+    int okonly;            /* -s */
+    long timeout;          /* deadline to arm on release (ms), or -1 */
+    int ndeps;             /* dependencies still running */
+    pid_t deps[MAXJOBS];
+    unsigned seq;          /* release order */
+} pending_t;
+
+static pending_t pending[MAXPENDING];
+static unsigned pendseq;
+static int running;        /* released and not yet reaped */
+static int limit;          /* max running at once, 0 for no limit */
+
+/*
+ * after_parse - Parse "after [-s] job ... -- cmd" into req and return the
+ *    index in argv where cmd starts.  Returns 0 if there is nothing to
+ *    run: after -j N (which just sets the limit) or an error.
+ */
+int after_parse(char **argv, int bg, after_t *req)
+{
+    char *p;
+    int i;
+
+    req->okonly = 0;
+    req->ndeps = 0;
+    for (i = 1; argv[i] != NULL && strcmp(argv[i], "--"); i++)
+    {
+        if (!strcmp(argv[i], "-s"))
+            req->okonly = 1;
+        else if (!strcmp(argv[i], "-j"))
+        {
+            if (argv[i + 1] == NULL || (limit = strtol(argv[i + 1], &p, 10), *p != '\0') ||
+                limit < 0)
+            {
+                limit = 0;
+                printf("%s: -j requires a number of jobs\n", argv[0]);
+            }
+            return 0;
+        }
+        else if (req->ndeps == MAXJOBS)
+        {
+            printf("%s: Too many dependencies\n", argv[0]);
+            return 0;
+        }
+        else
+            req->deps[req->ndeps++] = argv[i];
+    }
+
+    if (argv[i] == NULL || argv[i + 1] == NULL || req->ndeps == 0)
+    {
+        printf("usage: %s [-s] %%jobid|PID ... -- command &\n", argv[0]);
+        printf("       %s -j N\n", argv[0]);
+        return 0;
+    }
+    if (!bg)
+    {
+        printf("%s: the command must run in the background (&)\n", argv[0]);
+        return 0;
+    }
+    return i + 1;
+}
+
+/*
+ * after_resolve - Look up the jobs req depends on and make its go pipe.
+ *    Must be called with SIGCHLD blocked, so that none of them can be
+ *    reaped before after_add.  Returns -1 (with a message) on error.
+ */
+int after_resolve(after_t *req)
+{
+    job_t *job;
+    char *p;
+    int i;
+
+    for (i = 0; i < req->ndeps; i++)
+    {
+        if (req->deps[i][0] == '%')
+            job = getjobjid(jobs, strtol(req->deps[i] + 1, &p, 10));
+        else
+            job = getjobpid(jobs, strtol(req->deps[i], &p, 10));
+        if (*p != '\0' || p == req->deps[i])
+        {
+            printf("after: argument must be a PID or %%jobid\n");
+            return -1;
+        }
+        if (job == NULL)
+        {
+            if (req->deps[i][0] == '%')
+                printf("%s: No such job\n", req->deps[i]);
+            else
+                printf("(%s): No such process\n", req->deps[i]);
+            return -1;
+        }
+        req->pids[i] = job->pid;
+    }
+    if (pipe2(req->go, O_CLOEXEC) < 0)
+        unix_error("pipe error");
+    return 0;
+}
+
+/*
+ * after_wait - In the forked child: wait to be released.  Returns only
+ *    if the job is to run.
+ */
+void after_wait(after_t *req)
+{
+    char c = 0;
+
+    close(req->go[1]);
+    if (read(req->go[0], &c, 1) != 1 || c != 'r')
+        _exit(1); /* a dependency failed, or the shell went away */
+    close(req->go[0]);
+}
+
+/*
+ * after_child - In a child just forked: close the go pipes of the other
+ *    pending jobs
+ */
+void after_child(void)
+{
+    int i;
+
+    for (i = 0; i < MAXPENDING; i++)
+        if (pending[i].state != FREE && pending[i].fd >= 0)
+            close(pending[i].fd);
+}
+
+/* release - Let a pending job run */
+static void release(pending_t *p)
+{
+    job_t *job;
+
+    write(p->fd, "r", 1);
+    close(p->fd);
+    p->fd = -1;
+    p->state = RUNNING;
+    running++;
+    if ((job = getjobpid(p->owner, p->pid)) != NULL && job->state == PD)
+    {
+        job->state = BG;
+        if (p->timeout >= 0)
+            deadline_arm(job, p->timeout);
+        snapshot_update(job);
+    }
+}
+
+/* release_ready - Start ready jobs, oldest first, up to the limit */
+static void release_ready(void)
+{
+    pending_t *next;
+    int i;
+
+    while (limit == 0 || running < limit)
+    {
+        next = NULL;
+        for (i = 0; i < MAXPENDING; i++)
+            if (pending[i].state == READY && (next == NULL || pending[i].seq < next->seq))
+                next = &pending[i];
+        if (next == NULL)
+            return;
+        release(next);
+    }
+}
+
+/*
+ * after_add - Track the job just forked for req, whose deadline (ms, -1
+ *    for none) is armed when it is released.  Called with signals
+ *    blocked, after addjob has put it in the job list as Pending.
+ */
+void after_add(after_t *req, job_t *jobs, pid_t pid, long timeout)
+{
+    pending_t *p = NULL;
+    int i;
+
+    close(req->go[0]);
+    for (i = 0; i < MAXPENDING; i++)
+    {
+        if (pending[i].state == FREE)
+        {
+            p = &pending[i];
+            break;
+        }
+    }
+    if (p == NULL)
+    {
+        printf("Tried to create too many pending jobs\n");
+        write(req->go[1], "x", 1);
+        close(req->go[1]);
+        return;
+    }
+
+    p->state = WAITING;
+    p->owner = jobs;
+    p->pid = pid;
+    p->fd = req->go[1];
+    p->okonly = req->okonly;
+    p->timeout = timeout;
+    p->ndeps = req->ndeps;
+    memcpy(p->deps, req->pids, req->ndeps * sizeof(pid_t));
+    p->seq = ++pendseq;
+}
+
+/*
+ * after_reaped - Called from the reaping path, with signals blocked,
+ *    for every job that has exited or been killed (before deletejob)
+ */
+void after_reaped(pid_t pid, int status)
+{
+    int ok = WIFEXITED(status) && WEXITSTATUS(status) == 0;
+    job_t *job, *dep;
+    pending_t *p;
+    int i, j;
+
+    for (i = 0; i < MAXPENDING; i++)
+    {
+        p = &pending[i];
+        if (p->state == FREE)
+            continue;
+        if (p->pid == pid)
+        {
+            if (p->state == RUNNING)
+                running--;
+            if (p->fd >= 0)
+                close(p->fd);
+            p->state = FREE;
+            continue;
+        }
+        if (p->state != WAITING)
+            continue;
+
+        for (j = 0; j < p->ndeps; j++)
+        {
+            if (p->deps[j] != pid)
+                continue;
+            p->deps[j--] = p->deps[--p->ndeps];
+            if (!ok && p->okonly)
+            {
+                job = getjobpid(p->owner, p->pid);
+                dep = getjobpid(p->owner, pid);
+                printf("Job [%d] (%d) not run: dependency [%d] (%d) failed\n",
+                       job ? job->jid : 0, p->pid, dep ? dep->jid : 0, pid);
+                write(p->fd, "x", 1);
+                close(p->fd);
+                p->fd = -1;
+                p->state = ABORTED;
+                break;
+            }
+        }
+        if (p->state == WAITING && p->ndeps == 0)
+            p->state = READY;
+    }
+    release_ready();
+}
+
+/*
+ * after_forget - Drop the pending jobs of a job list that is going away
+ *    (a server session closing).  Their children see EOF and exit.
+ */
+void after_forget(job_t *jobs)
+{
+    int i;
+
+    for (i = 0; i < MAXPENDING; i++)
+    {
+        if (pending[i].state != FREE && pending[i].owner == jobs)
+        {
+            if (pending[i].state == RUNNING)
+                running--;
+            if (pending[i].fd >= 0)
+                close(pending[i].fd);
+            pending[i].state = FREE;
+        }
+    }
+    release_ready();
+}
@@ -0,0 +1,21 @@
+/* after [-s] job ... -- cmd &: run cmd once other jobs have finished.
+ * after -j N: run at most N released jobs at a time (0: no limit). */
+
+#define MAXPENDING (4 * MAXJOBS) /* after jobs tracked at any point in time */
+
+typedef struct
+{
+    int okonly;            /* -s: only run if every dependency succeeded */
+    int ndeps;             /* number of dependencies */
+    char *deps[MAXJOBS];   /* dependencies as typed: %jid or PID */
+    pid_t pids[MAXJOBS];   /* ... and the job PIDs they name */
+    int go[2];             /* pipe the new job waits on */
+} after_t;
+
+int after_parse(char **argv, int bg, after_t *req);
+int after_resolve(after_t *req);
+void after_wait(after_t *req);
+void after_child(void);
+void after_add(after_t *req, job_t *jobs, pid_t pid, long timeout);
+void after_reaped(pid_t pid, int status);
+void after_forget(job_t *jobs);
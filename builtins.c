@@ -0,0 +1,447 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <math.h>
+#include <time.h>
+#include "builtins.h"
+
+/* The simple builtins (AS_JOB in tsh.c's table).  None of them touch the
+ * job list, so the shell can run them in-process for foreground commands
+ * and in a forked child (with no exec) for background ones.  Output is
+ * meant to match the coreutils programs byte for byte.  An absolute path
+ * such as /bin/echo never reaches here and still runs the external
+ * program. */
+
+volatile sig_atomic_t builtin_intr; /* ctrl-c arrived while a builtin ran */
+
+/*
+ * put_escape - Output the backslash escape that starts at *sp (just past
+ *    the backslash) and advance *sp over it.  With octal0 set, octal
+ *    escapes may be written \0NNN as in echo -e and printf %b; otherwise
+ *    they are \NNN as in a printf format.  Returns 0 for \c, which means
+ *    "produce no further output".
+ */
+static int put_escape(char **sp, int octal0)
+{
+    char *s = *sp;
+    int c, i;
+
+    if (*s == '\0')
+    {
+        putchar('\\'); /* trailing backslash is literal */
+        return 1;
+    }
+    switch (c = *s++)
+    {
+        case 'a': c = '\a'; break;
+        case 'b': c = '\b'; break;
+        case 'c': *sp = s; return 0;
+        case 'e': c = 033; break;
+        case 'f': c = '\f'; break;
+        case 'n': c = '\n'; break;
+        case 'r': c = '\r'; break;
+        case 't': c = '\t'; break;
+        case 'v': c = '\v'; break;
+        case '\\': break;
+        case 'x':
+            if (!isxdigit((unsigned char) *s))
+            {
+                putchar('\\'); /* not an escape after all */
+                break;
+            }
+            for (c = 0, i = 0; i < 2 && isxdigit((unsigned char) *s); i++, s++)
+                c = c * 16 + (isdigit((unsigned char) *s) ? *s - '0'
+                                                          : tolower((unsigned char) *s) - 'a' + 10);
+            break;
+        case '0': case '1': case '2': case '3':
+        case '4': case '5': case '6': case '7':
+            s--;
+            if (octal0 && *s == '0') s++;
+            for (c = 0, i = 0; i < 3 && *s >= '0' && *s <= '7'; i++, s++)
+                c = c * 8 + (*s - '0');
+            break;
+        default:
+            putchar('\\');
+            break;
+    }
+    putchar(c);
+    *sp = s;
+    return 1;
+}
+
+/* put_escaped - Output str, interpreting backslash escapes.  Returns 0 on \c */
+static int put_escaped(char *str)
+{
+    char *s = str;
+
+    while (*s)
+    {
+        if (*s != '\\')
+        {
+            putchar(*s++);
+            continue;
+        }
+        s++;
+        if (!put_escape(&s, 1)) return 0;
+    }
+    return 1;
+}
+
+/*
+ * builtin_echo - echo [-neE] [arg ...]
+ *
+ * An argument is only taken as options if every character after the
+ * dash is one of n, e or E; anything else (including "-" and "--") is
+ * printed as text, just like /bin/echo.
+ */
+int builtin_echo(char **argv)
+{
+    int i, j;
+    int newline = 1, escapes = 0;
+
+    for (i = 1; argv[i] != NULL && argv[i][0] == '-' && argv[i][1] != '\0'; i++)
+    {
+        for (j = 1; argv[i][j] != '\0'; j++)
+            if (!strchr("neE", argv[i][j])) break;
+        if (argv[i][j] != '\0') break;
+
+        for (j = 1; argv[i][j] != '\0'; j++)
+        {
+            switch (argv[i][j])
+            {
+                case 'n': newline = 0; break;
+                case 'e': escapes = 1; break;
+                case 'E': escapes = 0; break;
+            }
+        }
+    }
+
+    for (; argv[i] != NULL; i++)
+    {
+        if (escapes)
+        {
+            if (!put_escaped(argv[i])) return 0;
+        }
+        else
+            fputs(argv[i], stdout);
+        if (argv[i + 1] != NULL) putchar(' ');
+    }
+    if (newline) putchar('\n');
+    return 0;
+}
+
+/* arg_intmax - Convert a printf argument for %d and %i */
+static intmax_t arg_intmax(char *arg, int *status)
+{
+    char *end;
+    intmax_t val;
+
+    if (arg == NULL) return 0;
+    if (*arg == '\'' || *arg == '"') return (unsigned char) arg[1];
+    errno = 0;
+    val = strtoimax(arg, &end, 0);
+    if (end == arg)
+    {
+        printf("printf: '%s': expected a numeric value\n", arg);
+        *status = 1;
+    }
+    else if (*end != '\0')
+    {
+        printf("printf: '%s': value not completely converted\n", arg);
+        *status = 1;
+    }
+    else if (errno == ERANGE)
+    {
+        printf("printf: '%s': %s\n", arg, strerror(errno));
+        *status = 1;
+    }
+    return val;
+}
+
+/* arg_uintmax - Convert a printf argument for %o, %u, %x and %X */
+static uintmax_t arg_uintmax(char *arg, int *status)
+{
+    char *end;
+    uintmax_t val;
+
+    if (arg == NULL) return 0;
+    if (*arg == '\'' || *arg == '"') return (unsigned char) arg[1];
+    errno = 0;
+    val = strtoumax(arg, &end, 0);
+    if (end == arg)
+    {
+        printf("printf: '%s': expected a numeric value\n", arg);
+        *status = 1;
+    }
+    else if (*end != '\0')
+    {
+        printf("printf: '%s': value not completely converted\n", arg);
+        *status = 1;
+    }
+    else if (errno == ERANGE)
+    {
+        printf("printf: '%s': %s\n", arg, strerror(errno));
+        *status = 1;
+    }
+    return val;
+}
+
+/* arg_double - Convert a printf argument for the floating point conversions */
+static long double arg_double(char *arg, int *status)
+{
+    char *end;
+    long double val;
+
+    if (arg == NULL) return 0;
+    if (*arg == '\'' || *arg == '"') return (unsigned char) arg[1];
+    errno = 0;
+    val = strtold(arg, &end);
+    if (end == arg)
+    {
+        printf("printf: '%s': expected a numeric value\n", arg);
+        *status = 1;
+    }
+    else if (*end != '\0')
+    {
+        printf("printf: '%s': value not completely converted\n", arg);
+        *status = 1;
+    }
+    return val;
+}
+
+/* Hand one converted value to the C library, with any '*' width/precision */
+#define PRINT_SPEC(spec, val)                                         \
+    do {                                                              \
+        if (have_width && have_prec)                                  \
+            printf(spec, width, prec, val);                           \
+        else if (have_width)                                          \
+            printf(spec, width, val);                                 \
+        else if (have_prec)                                           \
+            printf(spec, prec, val);                                  \
+        else                                                          \
+            printf(spec, val);                                        \
+    } while (0)
+
+/*
+ * print_format - Output one pass over the printf format, consuming
+ *    arguments from *argp.  Returns 0 if output must stop (\c or an
+ *    invalid conversion), 1 otherwise.
+ */
+static int print_format(char *format, char ***argp, int *status)
+{
+    char spec[64];
+    char *f, *dir, *arg;
+    int len, width, prec, have_width, have_prec;
+
+    for (f = format; *f != '\0'; f++)
+    {
+        if (*f == '\\')
+        {
+            f++;
+            if (!put_escape(&f, 0)) return 0;
+            f--;
+            continue;
+        }
+        if (*f != '%')
+        {
+            putchar(*f);
+            continue;
+        }
+        if (f[1] == '%')
+        {
+            putchar('%');
+            f++;
+            continue;
+        }
+
+        /* Copy the flags, width and precision of the directive into spec */
+        dir = f++;
+        len = 0;
+        spec[len++] = '%';
+        have_width = have_prec = 0;
+        width = prec = 0;
+        while (*f != '\0' && strchr("-+ #0'", *f) && len < 40)
+            spec[len++] = *f++;
+        if (*f == '*')
+        {
+            spec[len++] = *f++;
+            width = (int) arg_intmax(**argp, status);
+            if (**argp != NULL) (*argp)++;
+            have_width = 1;
+        }
+        else
+            while (isdigit((unsigned char) *f) && len < 40)
+                spec[len++] = *f++;
+        if (*f == '.')
+        {
+            spec[len++] = *f++;
+            if (*f == '*')
+            {
+                spec[len++] = *f++;
+                prec = (int) arg_intmax(**argp, status);
+                if (**argp != NULL) (*argp)++;
+                have_prec = 1;
+            }
+            else
+                while (isdigit((unsigned char) *f) && len < 40)
+                    spec[len++] = *f++;
+        }
+        while (*f != '\0' && strchr("hlLjzt", *f))
+            f++; /* length modifiers are accepted and ignored */
+
+        if (*f == '\0' || !strchr("diouxXfFeEgGaAcsb", *f))
+        {
+            printf("printf: %.*s: invalid conversion specification\n",
+                   (int) (f - dir) + (*f != '\0'), dir);
+            *status = 1;
+            return 0;
+        }
+
+        arg = **argp;
+        if (arg != NULL) (*argp)++;
+        switch (*f)
+        {
+            case 'd': case 'i':
+                spec[len++] = 'j';
+                spec[len++] = *f;
+                spec[len] = '\0';
+                PRINT_SPEC(spec, arg_intmax(arg, status));
+                break;
+            case 'o': case 'u': case 'x': case 'X':
+                spec[len++] = 'j';
+                spec[len++] = *f;
+                spec[len] = '\0';
+                PRINT_SPEC(spec, arg_uintmax(arg, status));
+                break;
+            case 'f': case 'F': case 'e': case 'E':
+            case 'g': case 'G': case 'a': case 'A':
+                spec[len++] = 'L';
+                spec[len++] = *f;
+                spec[len] = '\0';
+                PRINT_SPEC(spec, arg_double(arg, status));
+                break;
+            case 'c':
+                spec[len++] = 'c';
+                spec[len] = '\0';
+                PRINT_SPEC(spec, arg != NULL ? arg[0] : '\0');
+                break;
+            case 's':
+                spec[len++] = 's';
+                spec[len] = '\0';
+                PRINT_SPEC(spec, arg != NULL ? arg : "");
+                break;
+            case 'b':
+                if (arg != NULL && !put_escaped(arg)) return 0;
+                break;
+        }
+    }
+    return 1;
+}
+
+/*
+ * builtin_printf - printf format [argument ...]
+ *
+ * As in coreutils, the format is reused until the arguments run out,
+ * and missing arguments read as empty strings or zero.
+ */
+int builtin_printf(char **argv)
+{
+    char **args, **start;
+    int status = 0;
+
+    if (argv[1] == NULL)
+    {
+        printf("printf: missing operand\n");
+        printf("Try 'printf --help' for more information.\n");
+        return 1;
+    }
+
+    args = &argv[2];
+    do
+    {
+        start = args;
+        if (!print_format(argv[1], &args, &status)) return status;
+    } while (*args != NULL && args != start);
+
+    if (*args != NULL)
+        printf("printf: warning: ignoring excess arguments, starting with '%s'\n", *args);
+    return status;
+}
+
+/* builtin_true - Do nothing, successfully */
+int builtin_true(char **argv)
+{
+    return 0;
+}
+
+/* builtin_false - Do nothing, unsuccessfully */
+int builtin_false(char **argv)
+{
+    return 1;
+}
+
+/*
+ * builtin_sleep - sleep number[smhd] ...
+ *
+ * Fractional values are allowed and the arguments are summed.  ctrl-c
+ * cuts the sleep short (see sigint_handler); SIGCHLD does not.
+ */
+int builtin_sleep(char **argv)
+{
+    struct timespec req, rem;
+    double secs = 0, val;
+    char *end;
+    int i, bad = 0;
+
+    if (argv[1] == NULL)
+    {
+        printf("sleep: missing operand\n");
+        printf("Try 'sleep --help' for more information.\n");
+        return 1;
+    }
+
+    for (i = 1; argv[i] != NULL; i++)
+    {
+        val = strtod(argv[i], &end);
+        if (end == argv[i] || !(val >= 0) ||
+            (*end != '\0' && (end[1] != '\0' || !strchr("smhd", *end))))
+        {
+            printf("sleep: invalid time interval '%s'\n", argv[i]);
+            bad = 1;
+            continue;
+        }
+        switch (*end)
+        {
+            case 'm': val *= 60; break;
+            case 'h': val *= 60 * 60; break;
+            case 'd': val *= 24 * 60 * 60; break;
+        }
+        /* inf, or more than a time_t (a long here) holds */
+        if (!isfinite(val) || secs + val >= (double) LONG_MAX)
+        {
+            printf("sleep: invalid time interval '%s'\n", argv[i]);
+            bad = 1;
+            continue;
+        }
+        secs += val;
+    }
+    if (bad)
+    {
+        printf("Try 'sleep --help' for more information.\n");
+        return 1;
+    }
+
+    req.tv_sec = (time_t) secs;
+    req.tv_nsec = (long) ((secs - req.tv_sec) * 1e9);
+    builtin_intr = 0;
+    while (!builtin_intr && nanosleep(&req, &rem) < 0)
+    {
+        if (errno != EINTR) return 1;
+        req = rem;
+    }
+    return builtin_intr ? 130 : 0;
+}
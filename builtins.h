@@ -0,0 +1,13 @@
+/* Simple builtins that need no shell state: echo, printf, true, false
+ * and sleep.  They are run in-process to skip the fork+exec. */
+#include <signal.h>
+
+typedef int builtin_fn(char **argv);
+
+extern volatile sig_atomic_t builtin_intr; /* set by ctrl-c with no fg job */
+
+int builtin_echo(char **argv);
+int builtin_printf(char **argv);
+int builtin_true(char **argv);
+int builtin_false(char **argv);
+int builtin_sleep(char **argv);
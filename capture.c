@@ -0,0 +1,394 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/sendfile.h>
+#include "jobs.h"
+#include "wrappers.h"
+#include "capture.h"
+#include "server.h"
+
+/* A captured job writes into a pipe.  Whenever output arrives the kernel
+ * sends the shell SIGIO, and sigio_handler splices the pipe into the
+ * job's ring buffer, a CAPSIZE-byte memfd, so the data never passes
+ * through user space.  Once the ring is full, the bytes about to be
+ * overwritten are first sendfile'd to an anonymous spill file, so
+ * memory use stays bounded while nothing is lost.
+ *
+ * Offsets below are logical: byte o of the job's output is in the spill
+ * file at o if o < spilled, and otherwise in the ring at o % CAPSIZE.
+ *
+ * A capture outlives its job, so "output %1" still works after job 1
+ * has exited, until the jid is reused or the slot is needed. */
+
+typedef struct
+{
+    job_t *owner;  /* job list the job belongs to, NULL if slot free */
+    int jid;       /* job ID, 0 until attached */
+    pid_t pid;     /* job PID */
+    int pipefd;    /* read end of the job's output, -1 at EOF */
+    int memfd;     /* ring buffer */
+    int spillfd;   /* older output, -1 if none */
+    int nospill;   /* the spill file could not be created */
+    off_t total;   /* bytes captured so far */
+    off_t spilled; /* bytes in the spill file */
+    unsigned seq;  /* creation order, for reusing slots */
+} capture_t;
+
+int capturing = 0;
+static capture_t caps[MAXCAPS];
+static unsigned capseq;
+
+/* release - Free a capture slot */
+static void release(capture_t *cap)
+{
+    if (cap->pipefd >= 0) close(cap->pipefd);
+    if (cap->spillfd >= 0) close(cap->spillfd);
+    close(cap->memfd);
+    memset(cap, 0, sizeof(*cap));
+}
+
+/*
+ * capture_open - Set up a capture for a background job that is about to
+ *    be forked.  Returns the slot, with the pipe's write end in *wfd for
+ *    the child, or -1 if the job will have to run uncaptured.
+ */
+int capture_open(int *wfd)
+{
+    capture_t *cap = NULL;
+    int i, p[2], memfd;
+    sigset_t mask, prev;
+
+    /* A free slot, or else the oldest capture whose job is done */
+    for (i = 0; i < MAXCAPS; i++)
+    {
+        if (caps[i].owner == NULL)
+        {
+            cap = &caps[i];
+            break;
+        }
+        if (caps[i].pipefd < 0 && (cap == NULL || caps[i].seq < cap->seq))
+            cap = &caps[i];
+    }
+    if (cap == NULL)
+        return -1;
+
+    if ((memfd = memfd_create("tsh-output", MFD_CLOEXEC)) < 0)
+        return -1;
+    if (ftruncate(memfd, CAPSIZE) < 0 || pipe2(p, O_CLOEXEC | O_NONBLOCK) < 0)
+    {
+        close(memfd);
+        return -1;
+    }
+    fcntl(p[0], F_SETOWN, getpid());
+    fcntl(p[0], F_SETFL, O_NONBLOCK | O_ASYNC);
+    fcntl(p[1], F_SETFL, 0); /* the job itself writes normally */
+
+    Sigemptyset(&mask);
+    Sigaddset(&mask, SIGIO);
+    Sigprocmask(SIG_BLOCK, &mask, &prev);
+    if (cap->owner != NULL)
+        release(cap);
+    cap->owner = jobs;
+    cap->pipefd = p[0];
+    cap->memfd = memfd;
+    cap->spillfd = -1;
+    cap->seq = ++capseq;
+    Sigprocmask(SIG_SETMASK, &prev, NULL);
+
+    *wfd = p[1];
+    return cap - caps;
+}
+
+/*
+ * capture_attach - Record the job that capture_open's slot belongs to.
+ *    Called with signals blocked, once addjob has assigned the jid.
+ */
+void capture_attach(int slot, job_t *jobs, int jid, pid_t pid)
+{
+    int i;
+
+    for (i = 0; i < MAXCAPS; i++)
+        if (i != slot && caps[i].owner == jobs && caps[i].jid == jid)
+            release(&caps[i]); /* output of an earlier job with this jid */
+    caps[slot].jid = jid;
+    caps[slot].pid = pid;
+}
+
+/*
+ * capture_forget - Drop the captures of a job list that is going away
+ *    (a server session closing), so a later list at the same address
+ *    cannot read them
+ */
+void capture_forget(job_t *jobs)
+{
+    sigset_t mask, prev;
+    int i;
+
+    Sigemptyset(&mask);
+    Sigaddset(&mask, SIGIO);
+    Sigprocmask(SIG_BLOCK, &mask, &prev);
+    for (i = 0; i < MAXCAPS; i++)
+        if (caps[i].owner == jobs)
+            release(&caps[i]);
+    Sigprocmask(SIG_SETMASK, &prev, NULL);
+}
+
+/*
+ * spill - Move ring bytes [cap->spilled, upto) to the spill file before
+ *    they are overwritten.  On failure the older output is dropped.
+ */
+static void spill(capture_t *cap, off_t upto)
+{
+    off_t off;
+    ssize_t n;
+
+    if (cap->nospill)
+        return;
+    if (cap->spillfd < 0)
+    {
+        cap->spillfd = open(P_tmpdir, O_TMPFILE | O_RDWR | O_CLOEXEC, 0600);
+        if (cap->spillfd < 0)
+        {
+            cap->nospill = 1;
+            return;
+        }
+    }
+    while (cap->spilled < upto)
+    {
+        off = cap->spilled % CAPSIZE;
+        if ((n = sendfile(cap->spillfd, cap->memfd, &off, upto - cap->spilled)) <= 0)
+        {
+            close(cap->spillfd);
+            cap->spillfd = -1;
+            cap->spilled = 0;
+            cap->nospill = 1;
+            return;
+        }
+        cap->spilled += n;
+    }
+}
+
+/* drain - Splice whatever a job has written into its ring buffer */
+static void drain(capture_t *cap)
+{
+    loff_t off;
+    ssize_t n;
+    int avail;
+    size_t len;
+
+    while (cap->pipefd >= 0)
+    {
+        off = cap->total % CAPSIZE;
+        len = CAPSIZE - off;
+        if (ioctl(cap->pipefd, FIONREAD, &avail) < 0 || avail <= 0)
+            avail = 1; /* enough to see EOF */
+        if ((size_t) avail < len)
+            len = avail;
+        if (cap->total + (off_t) len > CAPSIZE)
+            spill(cap, cap->total + len - CAPSIZE);
+
+        n = splice(cap->pipefd, NULL, cap->memfd, &off, len, SPLICE_F_NONBLOCK);
+        if (n > 0)
+        {
+            cap->total += n;
+            continue;
+        }
+        if (n < 0 && errno == EAGAIN)
+            break;
+        close(cap->pipefd); /* EOF: every process in the job closed it */
+        cap->pipefd = -1;
+    }
+}
+
+/* capture_drain - Pull in pending output from every captured job */
+void capture_drain(void)
+{
+    int i;
+
+    for (i = 0; i < MAXCAPS; i++)
+        if (caps[i].owner != NULL && caps[i].pipefd >= 0)
+            drain(&caps[i]);
+}
+
+/*
+ * sigio_handler - The kernel sends a SIGIO when a captured job writes
+ *    output or closes its end of the pipe.
+ */
+void sigio_handler(int sig)
+{
+    int olderrno = errno;
+
+    capture_drain();
+    errno = olderrno;
+}
+
+/* first_byte - Oldest byte of a capture that is still available */
+static off_t first_byte(capture_t *cap)
+{
+    if (cap->spillfd >= 0 || cap->total <= CAPSIZE)
+        return 0;
+    return cap->total - CAPSIZE;
+}
+
+/*
+ * capture_pread - Read n bytes at logical offset off into buf
+ */
+static int capture_pread(capture_t *cap, char *buf, size_t n, off_t off)
+{
+    size_t len;
+    int fd;
+    off_t pos;
+
+    while (n > 0)
+    {
+        if (off < cap->spilled)
+        {
+            fd = cap->spillfd;
+            pos = off;
+            len = cap->spilled - off;
+        }
+        else
+        {
+            fd = cap->memfd;
+            pos = off % CAPSIZE;
+            len = CAPSIZE - pos;
+        }
+        if (len > n) len = n;
+        if (pread(fd, buf, len, pos) != (ssize_t) len) return -1;
+        buf += len;
+        off += len;
+        n -= len;
+    }
+    return 0;
+}
+
+/*
+ * tail_start - Logical offset of the start of the last `lines' lines.
+ *    A final newline ends the last line rather than starting a new one.
+ */
+static off_t tail_start(capture_t *cap, int lines, off_t first)
+{
+    char buf[4096];
+    off_t pos = cap->total;
+    size_t n;
+    int i;
+
+    if (lines == 0)
+        return cap->total;
+    while (pos > first)
+    {
+        n = (pos - first < (off_t) sizeof(buf)) ? pos - first : sizeof(buf);
+        if (capture_pread(cap, buf, n, pos - n) < 0)
+            return first;
+        pos -= n;
+        for (i = n - 1; i >= 0; i--)
+            if (buf[i] == '\n' && pos + i != cap->total - 1 && --lines == 0)
+                return pos + i + 1;
+    }
+    return first;
+}
+
+/* copy_out - Write len bytes of fd at pos to stdout (in server mode,
+ * through stdio to the session's queue: see server.c) */
+static void copy_out(int fd, off_t pos, size_t len)
+{
+    char buf[4096];
+    ssize_t n;
+
+    while (len > 0 && !serving)
+    {
+        if ((n = sendfile(STDOUT_FILENO, fd, &pos, len)) <= 0)
+            break;
+        len -= n;
+    }
+    /* sendfile refuses some outputs (an O_APPEND file, say) */
+    while (len > 0)
+    {
+        n = pread(fd, buf, len < sizeof(buf) ? len : sizeof(buf), pos);
+        if (n <= 0)
+            break;
+        if (serving ? fwrite(buf, 1, n, stdout) != (size_t) n : write(STDOUT_FILENO, buf, n) != n)
+            break;
+        pos += n;
+        len -= n;
+    }
+}
+
+/*
+ * do_output - Execute the builtin output command:
+ *    output %jid [--tail N]
+ */
+void do_output(char **argv)
+{
+    capture_t *cap = NULL;
+    sigset_t mask, prev;
+    off_t start, pos, end;
+    size_t len;
+    int i, jid, lines = -1;
+    char *p;
+
+    if (argv[1] == NULL)
+    {
+        printf("%s command requires %%jobid argument\n", argv[0]);
+        return;
+    }
+    if (argv[1][0] != '%' || (jid = strtol(argv[1] + 1, &p, 10)) <= 0 || *p != '\0')
+    {
+        printf("%s: argument must be a %%jobid\n", argv[0]);
+        return;
+    }
+    if (argv[2] != NULL)
+    {
+        if (strcmp(argv[2], "--tail") || argv[3] == NULL ||
+            (lines = strtol(argv[3], &p, 10)) < 0 || *p != '\0' || argv[4] != NULL)
+        {
+            printf("usage: %s %%jobid [--tail N]\n", argv[0]);
+            return;
+        }
+    }
+
+    /* Keep the handler from moving the ring under us */
+    Sigemptyset(&mask);
+    Sigaddset(&mask, SIGIO);
+    Sigprocmask(SIG_BLOCK, &mask, &prev);
+    capture_drain();
+
+    for (i = 0; i < MAXCAPS; i++)
+        if (caps[i].owner == jobs && caps[i].jid == jid)
+            cap = &caps[i];
+    if (cap == NULL)
+    {
+        printf("%s: No captured output\n", argv[1]);
+        Sigprocmask(SIG_SETMASK, &prev, NULL);
+        return;
+    }
+
+    fflush(stdout);
+    start = first_byte(cap);
+    if (lines >= 0)
+        start = tail_start(cap, lines, start);
+    end = cap->total;
+
+    for (pos = start; pos < end; pos += len)
+    {
+        if (pos < cap->spilled)
+        {
+            len = (end < cap->spilled ? end : cap->spilled) - pos;
+            copy_out(cap->spillfd, pos, len);
+        }
+        else
+        {
+            len = CAPSIZE - pos % CAPSIZE;
+            if ((off_t) len > end - pos) len = end - pos;
+            copy_out(cap->memfd, pos % CAPSIZE, len);
+        }
+    }
+    Sigprocmask(SIG_SETMASK, &prev, NULL);
+}
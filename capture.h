@@ -0,0 +1,16 @@
+/* Captured output of background jobs (tsh -c).  Each job's stdout and
+ * stderr go to a pipe that the shell splices into a bounded ring buffer;
+ * the output builtin reads it back. */
+#include <sys/types.h>
+
+#define CAPSIZE   (64 * 1024) /* ring buffer bytes per job */
+#define MAXCAPS   64          /* captures kept at any point in time */
+
+extern int capturing; /* true if background output is captured (-c) */
+
+int capture_open(int *wfd);
+void capture_attach(int slot, job_t *jobs, int jid, pid_t pid);
+void capture_forget(job_t *jobs);
+void capture_drain(void);
+void sigio_handler(int sig);
+void do_output(char **argv);
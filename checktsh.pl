@@ -22,13 +22,14 @@ STDERR->autoflush();
 sub usage 
 {
     printf STDERR "$_[0]\n";
-    printf STDERR "Usage: $0 [-hve] [-t <tracefile>] [-c <num>]\n";
+    printf STDERR "Usage: $0 [-hve] [-t <tracefile>] [-c <num>] [-T <scale>]\n";
     printf STDERR "Options:\n";
     printf STDERR "  -h              Print this message\n";
     printf STDERR "  -t <tracefile>  Check <tracefile> (default: check all)\n";
     printf STDERR "  -c <num>        Check tracefiles up to trace<num> (default: check all)\n";
     printf STDERR "  -v              Trace our progress\n";
     printf STDERR "  -e              Like -v, but trace output only on error\n";
+    printf STDERR "  -T <scale>      Scale the traces' delays by <scale> (see sdriver.pl)\n";
     die "\n" ;
 }
 
@@ -301,7 +302,7 @@ sub check_trace13 {
 sub check_trace {
 
     my $tracefile = $_[0];
-    my $driver = "./sdriver.pl";
+    my $driver = "./sdriver.pl -T $scale";
     my $tsh = "./tsh";
     my $tshref = "./tshref";
     my $tmpdir = "/tmp/tsh$$";
@@ -425,13 +426,14 @@ sub check_trace {
 # Main routine
 ##############
 
-getopts('hevt:c:');
+getopts('hevt:c:T:');
 if ($opt_h) {
     usage();
 }
 $verbose = $opt_v;
 $etrace = $opt_e;
 $count = $opt_c;
+$scale = $opt_T ? $opt_T : 1;
 
 $tmpdir = "/tmp/tsh$$";
 
@@ -0,0 +1,273 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/time.h>
+#include "jobs.h"
+#include "wrappers.h"
+#include "deadline.h"
+#include "reaper.h"
+
+/* All deadlines live in one hierarchical timer wheel: WHEEL_LEVELS
+ * levels of WHEEL_SIZE slots, level n covering WHEEL_SIZE^(n+1) ticks.
+ * Arming or cancelling is a list insert or unlink.  When level 0 wraps,
+ * the next slot of level 1 is cascaded down into it, and so on up.
+ *
+ * The wheel is driven by a single interval timer.  It is one-shot and
+ * set for the next non-empty level-0 slot (or the next cascade), so an
+ * idle shell takes no timer interrupts at all.  (A timerfd would suit
+ * an event loop, but the shell spends its time blocked in fgets and a
+ * timerfd cannot raise a signal.) */
+
+#define TICK_MS      10
+#define WHEEL_BITS   6
+#define WHEEL_SIZE   (1 << WHEEL_BITS)
+#define WHEEL_MASK   (WHEEL_SIZE - 1)
+#define WHEEL_LEVELS 4 /* 64^4 ticks, about 46 hours */
+#define MAX_TICKS    ((1UL << (WHEEL_BITS * WHEEL_LEVELS)) - 1)
+
+/* Stages of a deadline */
+#define TERM 0 /* SIGTERM when it expires */
+#define KILL 1 /* SIGKILL when it expires */
+#define DONE 2 /* both sent; off the wheel until the job is reaped */
+
+static struct deadline wheel[WHEEL_LEVELS][WHEEL_SIZE]; /* list heads */
+static unsigned long curtick;  /* next tick to run */
+static struct timespec epoch;  /* time of tick 0 */
+static int armed;              /* deadlines on the wheel */
+
+/*
+ * parse_duration - Convert 30s, 500ms, 2m, 1h or a bare number of
+ *    seconds (fractions allowed) to milliseconds.  Returns -1 if invalid.
+ */
+long parse_duration(const char *s)
+{
+    char *end;
+    double val = strtod(s, &end);
+
+    if (end == s || !(val >= 0))
+        return -1;
+    if (!strcmp(end, "ms"))
+        return (long) val;
+    if (!strcmp(end, "") || !strcmp(end, "s"))
+        return (long) (val * 1000);
+    if (!strcmp(end, "m"))
+        return (long) (val * 60 * 1000);
+    if (!strcmp(end, "h"))
+        return (long) (val * 60 * 60 * 1000);
+    return -1;
+}
+
+/* clock_ticks - Ticks elapsed since the wheel started */
+static unsigned long clock_ticks(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - epoch.tv_sec) * (1000 / TICK_MS) +
+           (now.tv_nsec - epoch.tv_nsec) / (TICK_MS * 1000000L);
+}
+
+/* wheel_init - Make every slot an empty circular list */
+static void wheel_init(void)
+{
+    int i, j;
+
+    clock_gettime(CLOCK_MONOTONIC, &epoch);
+    for (i = 0; i < WHEEL_LEVELS; i++)
+        for (j = 0; j < WHEEL_SIZE; j++)
+            wheel[i][j].next = wheel[i][j].prev = &wheel[i][j];
+}
+
+/* unlink_node - Take a deadline off its slot */
+static void unlink_node(struct deadline *d)
+{
+    d->prev->next = d->next;
+    d->next->prev = d->prev;
+    d->next = d->prev = NULL;
+}
+
+/* insert - Put a deadline in the slot for its expiry tick */
+static void insert(struct deadline *d)
+{
+    struct deadline *head;
+    unsigned long delta;
+    int level;
+
+    if (d->expires < curtick)
+        d->expires = curtick; /* overdue: run it on the next tick */
+    delta = d->expires - curtick;
+    if (delta > MAX_TICKS)
+        d->expires = curtick + (delta = MAX_TICKS);
+
+    for (level = 0; level < WHEEL_LEVELS - 1; level++)
+        if (delta < (1UL << (WHEEL_BITS * (level + 1))))
+            break;
+    head = &wheel[level][(d->expires >> (WHEEL_BITS * level)) & WHEEL_MASK];
+
+    d->next = head;
+    d->prev = head->prev;
+    head->prev->next = d;
+    head->prev = d;
+}
+
+/* cascade - Re-insert one slot of a higher level into the levels below */
+static int cascade(int level)
+{
+    int idx = (curtick >> (WHEEL_BITS * level)) & WHEEL_MASK;
+    struct deadline *head = &wheel[level][idx];
+    struct deadline *d, *next;
+
+    d = head->next;
+    head->next = head->prev = head;
+    for (; d != head; d = next)
+    {
+        next = d->next;
+        insert(d);
+    }
+    return idx;
+}
+
+/* expire - A deadline's time has come */
+static void expire(struct deadline *d)
+{
+    if (d->stage == TERM)
+    {
+        reaper_kill(d->pid, SIGTERM);
+        reaper_kill(d->pid, SIGCONT); /* a stopped job must see it too */
+        d->stage = KILL;
+        d->expires = curtick + TIMEOUT_GRACE_MS / TICK_MS;
+        insert(d);
+        return;
+    }
+    reaper_kill(d->pid, SIGKILL);
+    d->stage = DONE;
+    armed--;
+}
+
+/* wheel_run - Run every tick up to the present */
+static void wheel_run(void)
+{
+    unsigned long now = clock_ticks();
+    struct deadline *head, *d;
+    int level;
+
+    while (armed > 0 && curtick <= now)
+    {
+        /* Level 0 wrapped: bring down the next slot of each level above */
+        for (level = 1; level < WHEEL_LEVELS; level++)
+            if (((curtick >> (WHEEL_BITS * (level - 1))) & WHEEL_MASK) != 0 ||
+                cascade(level) != 0)
+                break;
+
+        head = &wheel[0][curtick & WHEEL_MASK];
+        while ((d = head->next) != head)
+        {
+            unlink_node(d);
+            expire(d);
+        }
+        curtick++;
+    }
+    if (armed == 0)
+        curtick = now + 1; /* nothing to catch up on next time */
+}
+
+/* wheel_rearm - Set the interval timer for the next tick with work */
+static void wheel_rearm(void)
+{
+    struct itimerval it;
+    unsigned long ticks;
+    long ms;
+
+    memset(&it, 0, sizeof(it));
+    if (armed > 0)
+    {
+        /* The next non-empty level-0 slot, or the next cascade */
+        for (ticks = 0; ticks < WHEEL_SIZE - (curtick & WHEEL_MASK); ticks++)
+            if (wheel[0][(curtick + ticks) & WHEEL_MASK].next !=
+                &wheel[0][(curtick + ticks) & WHEEL_MASK])
+                break;
+        ms = (long) (curtick + ticks - clock_ticks()) * TICK_MS;
+        if (ms < TICK_MS)
+            ms = TICK_MS;
+        it.it_value.tv_sec = ms / 1000;
+        it.it_value.tv_usec = (ms % 1000) * 1000;
+    }
+    setitimer(ITIMER_REAL, &it, NULL);
+}
+
+/*
+ * deadline_arm - Give a job ms milliseconds before it is terminated
+ */
+void deadline_arm(job_t *job, long ms)
+{
+    struct deadline *d = &job->timer;
+    sigset_t mask, prev;
+
+    Sigemptyset(&mask);
+    Sigaddset(&mask, SIGALRM);
+    Sigprocmask(SIG_BLOCK, &mask, &prev);
+    if (wheel[0][0].next == NULL)
+        wheel_init();
+    wheel_run();
+    d->pid = job->pid;
+    d->stage = TERM;
+    d->expires = clock_ticks() + (ms + TICK_MS - 1) / TICK_MS;
+    insert(d);
+    armed++;
+    job->deadline = d;
+    wheel_rearm();
+    Sigprocmask(SIG_SETMASK, &prev, NULL);
+}
+
+/*
+ * deadline_cancel - Drop a job's deadline (the job has been reaped)
+ */
+void deadline_cancel(job_t *job)
+{
+    struct deadline *d = job->deadline;
+    sigset_t mask, prev;
+
+    Sigemptyset(&mask);
+    Sigaddset(&mask, SIGALRM);
+    Sigprocmask(SIG_BLOCK, &mask, &prev);
+    if (d->stage != DONE)
+    {
+        unlink_node(d);
+        armed--;
+    }
+    job->deadline = NULL;
+    Sigprocmask(SIG_SETMASK, &prev, NULL);
+}
+
+/*
+ * deadline_left - Milliseconds until a job is sent SIGTERM,
+ *    or -1 if that has already happened
+ */
+long deadline_left(job_t *job)
+{
+    struct deadline *d = job->deadline;
+    unsigned long now = clock_ticks();
+
+    if (d->stage != TERM)
+        return -1;
+    return (d->expires > now) ? (long) (d->expires - now) * TICK_MS : 0;
+}
+
+/*
+ * sigalrm_handler - The interval timer fired: run the wheel
+ */
+void sigalrm_handler(int sig)
+{
+    int olderrno = errno;
+    sigset_t mask_all, prev_all;
+
+    Sigfillset(&mask_all);
+    Sigprocmask(SIG_BLOCK, &mask_all, &prev_all);
+    wheel_run();
+    wheel_rearm();
+    Sigprocmask(SIG_SETMASK, &prev_all, NULL);
+    errno = olderrno;
+}
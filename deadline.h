@@ -0,0 +1,10 @@
+/* Job deadlines (timeout=DURATION cmd).  A job that outlives its deadline
+ * gets SIGTERM, then SIGKILL TIMEOUT_GRACE_MS later. */
+
+#define TIMEOUT_GRACE_MS 2000 /* from SIGTERM to SIGKILL */
+
+long parse_duration(const char *s);
+void deadline_arm(job_t *job, long ms);
+void deadline_cancel(job_t *job);
+long deadline_left(job_t *job);
+void sigalrm_handler(int sig);
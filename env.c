@@ -0,0 +1,428 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include "wrappers.h"
+#include "env.h"
+
+/* Variables live in an open-addressing hash table (linear probing,
+ * removal by shifting later entries back, so there are no tombstones).
+ * Each entry holds its "NAME=value" string, which is also what envp
+ * points at.
+ *
+ * env_envp rebuilds envp only when a variable has been added or removed
+ * since the last call.  Changing the value of an existing variable just
+ * swaps its pointer in place, because each entry remembers its index in
+ * envp.  So launching a command normally costs nothing here, however
+ * large the environment is.
+ *
+ * In server mode each session starts out sharing the shell's
+ * environment, and gets its own copy the first time it changes it. */
+
+#define MINSLOTS 64
+
+typedef struct
+{
+    char *var;       /* "NAME=value", NULL if the slot is empty */
+    size_t namelen;  /* length of NAME */
+    unsigned hash;   /* hash of NAME */
+    size_t index;    /* position in envp as of the last rebuild */
+} var_t;
+
+struct env
+{
+    int refs;        /* sessions sharing this environment */
+    size_t size;     /* slots, a power of two */
+    size_t count;    /* variables */
+    var_t *slots;
+    char **envp;     /* NULL-terminated, valid unless dirty */
+    size_t envcap;   /* room in envp, including the NULL */
+    int dirty;       /* a variable was added or removed */
+};
+
+env_t *env;
+
+/* hash - FNV-1a hash of a variable name */
+static unsigned hash(const char *name, size_t len)
+{
+    unsigned h = 2166136261u;
+
+    while (len-- > 0)
+        h = (h ^ (unsigned char) *name++) * 16777619u;
+    return h;
+}
+
+/* find - Slot holding name, or the empty slot where it would go */
+static size_t find(env_t *e, const char *name, size_t len, unsigned h)
+{
+    size_t i = h & (e->size - 1);
+
+    while (e->slots[i].var != NULL &&
+           (e->slots[i].hash != h || e->slots[i].namelen != len ||
+            memcmp(e->slots[i].var, name, len)))
+        i = (i + 1) & (e->size - 1);
+    return i;
+}
+
+/* env_alloc - An empty environment with room for size slots */
+static env_t *env_alloc(size_t size)
+{
+    env_t *e;
+
+    if ((e = malloc(sizeof(env_t))) == NULL ||
+        (e->slots = calloc(size, sizeof(var_t))) == NULL)
+        unix_error("malloc error");
+    e->refs = 1;
+    e->size = size;
+    e->count = 0;
+    e->envp = NULL;
+    e->envcap = 0;
+    e->dirty = 1;
+    return e;
+}
+
+/* grow - Double the table, keeping it at most 3/4 full */
+static void grow(env_t *e)
+{
+    var_t *old = e->slots;
+    size_t i, j, oldsize = e->size;
+
+    e->size *= 2;
+    if ((e->slots = calloc(e->size, sizeof(var_t))) == NULL)
+        unix_error("malloc error");
+    for (i = 0; i < oldsize; i++)
+    {
+        if (old[i].var == NULL)
+            continue;
+        j = find(e, old[i].var, old[i].namelen, old[i].hash);
+        e->slots[j] = old[i];
+    }
+    free(old);
+}
+
+/* insert - Add or replace a variable; var becomes the table's */
+static void insert(env_t *e, char *var, size_t namelen)
+{
+    unsigned h = hash(var, namelen);
+    size_t i;
+
+    if ((e->count + 1) * 4 > e->size * 3)
+        grow(e);
+    i = find(e, var, namelen, h);
+    if (e->slots[i].var != NULL)
+    {
+        /* Same name: envp can be patched rather than rebuilt */
+        if (!e->dirty)
+            e->envp[e->slots[i].index] = var;
+        free(e->slots[i].var);
+        e->slots[i].var = var;
+        return;
+    }
+    e->slots[i].var = var;
+    e->slots[i].namelen = namelen;
+    e->slots[i].hash = h;
+    e->count++;
+    e->dirty = 1;
+}
+
+/* own - Make the current environment private before changing it */
+static void own(void)
+{
+    env_t *copy;
+    size_t i;
+
+    if (env->refs == 1)
+        return;
+    copy = env_alloc(env->size);
+    for (i = 0; i < env->size; i++)
+    {
+        if (env->slots[i].var == NULL)
+            continue;
+        copy->slots[i] = env->slots[i];
+        if ((copy->slots[i].var = strdup(env->slots[i].var)) == NULL)
+            unix_error("malloc error");
+    }
+    copy->count = env->count;
+    env->refs--;
+    env = copy;
+}
+
+/*
+ * env_init - Start from the environment the shell was given
+ */
+void env_init(char **envp)
+{
+    char *var, *eq;
+
+    env = env_alloc(MINSLOTS);
+    for (; *envp != NULL; envp++)
+    {
+        if ((eq = strchr(*envp, '=')) == NULL)
+            continue;
+        if ((var = strdup(*envp)) == NULL)
+            unix_error("malloc error");
+        insert(env, var, eq - *envp);
+    }
+}
+
+/* env_share - Take another reference to an environment */
+env_t *env_share(env_t *e)
+{
+    e->refs++;
+    return e;
+}
+
+/* env_release - Drop a reference, freeing the environment with the last */
+void env_release(env_t *e)
+{
+    size_t i;
+
+    if (--e->refs > 0)
+        return;
+    for (i = 0; i < e->size; i++)
+        free(e->slots[i].var);
+    free(e->slots);
+    free(e->envp);
+    free(e);
+}
+
+/* name_length - Length of the variable name at the start of s, 0 if none */
+static size_t name_length(const char *s)
+{
+    size_t len = 0;
+
+    if (!isalpha((unsigned char) s[0]) && s[0] != '_')
+        return 0;
+    while (isalnum((unsigned char) s[len]) || s[len] == '_')
+        len++;
+    return len;
+}
+
+/*
+ * env_assignment - If word is NAME=value, return the length of NAME,
+ *    otherwise 0
+ */
+int env_assignment(const char *word)
+{
+    size_t len = name_length(word);
+
+    return (len > 0 && word[len] == '=') ? len : 0;
+}
+
+/*
+ * env_get - Value of the variable whose name is the first len bytes of
+ *    name, or NULL if it is not set
+ */
+const char *env_get(const char *name, size_t len)
+{
+    size_t i = find(env, name, len, hash(name, len));
+
+    return (env->slots[i].var != NULL) ? env->slots[i].var + len + 1 : NULL;
+}
+
+/*
+ * env_set - Set a variable from var, "NAME=value" with a NAME namelen
+ *    bytes long
+ */
+void env_set(const char *var, size_t namelen)
+{
+    char *copy;
+
+    if ((copy = strdup(var)) == NULL)
+        unix_error("malloc error");
+    own();
+    insert(env, copy, namelen);
+}
+
+/*
+ * env_unset - Remove a variable, if it is set
+ */
+void env_unset(const char *name)
+{
+    size_t len = strlen(name), i, j, home;
+
+    i = find(env, name, len, hash(name, len));
+    if (env->slots[i].var == NULL)
+        return;
+    own();
+    i = find(env, name, len, hash(name, len));
+    free(env->slots[i].var);
+    env->slots[i].var = NULL;
+    env->count--;
+    env->dirty = 1;
+
+    /* Shift back later entries of the run that could no longer be found */
+    for (j = (i + 1) & (env->size - 1); env->slots[j].var != NULL;
+         j = (j + 1) & (env->size - 1))
+    {
+        home = env->slots[j].hash & (env->size - 1);
+        if (((j - home) & (env->size - 1)) >= ((j - i) & (env->size - 1)))
+        {
+            env->slots[i] = env->slots[j];
+            env->slots[j].var = NULL;
+            i = j;
+        }
+    }
+}
+
+/*
+ * env_envp - The environment as an envp array for execve
+ */
+char **env_envp(void)
+{
+    size_t i, n = 0;
+
+    if (!env->dirty)
+        return env->envp;
+    if (env->count + 1 > env->envcap)
+    {
+        env->envcap = (env->count + 1) * 2;
+        if ((env->envp = realloc(env->envp, env->envcap * sizeof(char *))) == NULL)
+            unix_error("malloc error");
+    }
+    for (i = 0; i < env->size; i++)
+    {
+        if (env->slots[i].var == NULL)
+            continue;
+        env->slots[i].index = n;
+        env->envp[n++] = env->slots[i].var;
+    }
+    env->envp[n] = NULL;
+    env->dirty = 0;
+    return env->envp;
+}
+
+/*
+ * env_with - In a forked child: envp with the n NAME=value words in
+ *    assign applied on top.  Works on the child's own copy of the array
+ *    that the parent built, so nothing is rebuilt or copied.
+ */
+char **env_with(char **assign, int n)
+{
+    char **envp = env_envp();
+    size_t i, len, count = env->count, nlen;
+    int k;
+
+    for (k = 0; k < n; k++)
+    {
+        nlen = name_length(assign[k]);
+        i = find(env, assign[k], nlen, hash(assign[k], nlen));
+        if (env->slots[i].var != NULL)
+        {
+            envp[env->slots[i].index] = assign[k];
+            continue;
+        }
+
+        /* A new name, unless an earlier word added it already */
+        for (len = env->count; len < count; len++)
+            if (!strncmp(envp[len], assign[k], nlen + 1))
+                break;
+        if (len == count)
+        {
+            if (count + 2 > env->envcap)
+            {
+                env->envcap = count + n + 1;
+                if ((envp = realloc(envp, env->envcap * sizeof(char *))) == NULL)
+                    unix_error("malloc error");
+            }
+            count++;
+        }
+        envp[len] = assign[k];
+    }
+    envp[count] = NULL;
+    return envp;
+}
+
+/*
+ * env_expand - Copy the len bytes of an unquoted word at src to dst,
+ *    replacing $NAME and ${NAME} with the variable's value (nothing if
+ *    it is not set).  Returns -1 if the result does not fit in size bytes.
+ */
+int env_expand(const char *src, size_t len, char *dst, size_t size)
+{
+    const char *p = src, *end = src + len, *name, *val;
+    size_t n = 0, vlen;
+    int brace;
+
+    while (p < end)
+    {
+        /* The word ends at a space or a connector, never in a name */
+        brace = (p[0] == '$' && p[1] == '{');
+        name = p + 1 + brace;
+        vlen = (*p == '$') ? name_length(name) : 0;
+        if (vlen == 0 || (brace && name[vlen] != '}'))
+        {
+            if (n + 1 >= size)
+                return -1;
+            dst[n++] = *p++;
+            continue;
+        }
+
+        if ((val = env_get(name, vlen)) != NULL)
+        {
+            if (n + strlen(val) >= size)
+                return -1;
+            strcpy(dst + n, val);
+            n += strlen(val);
+        }
+        p = name + vlen + brace;
+    }
+    dst[n] = '\0';
+    return 0;
+}
+
+/* by_name - qsort order for export's listing */
+static int by_name(const void *a, const void *b)
+{
+    return strcmp(*(char **) a, *(char **) b);
+}
+
+/*
+ * do_export - Execute the builtin export command:
+ *    export [NAME[=value] ...]
+ * With no arguments, list the environment.  Returns 1 if a name was
+ * not valid, else 0.
+ */
+int do_export(char **argv)
+{
+    char **envp, **sorted;
+    size_t i, len;
+    int status = 0;
+
+    if (argv[1] == NULL)
+    {
+        envp = env_envp();
+        if ((sorted = malloc((env->count + 1) * sizeof(char *))) == NULL)
+            unix_error("malloc error");
+        memcpy(sorted, envp, (env->count + 1) * sizeof(char *));
+        qsort(sorted, env->count, sizeof(char *), by_name);
+        for (i = 0; i < env->count; i++)
+            printf("export %s\n", sorted[i]);
+        free(sorted);
+        return 0;
+    }
+
+    for (argv++; *argv != NULL; argv++)
+    {
+        len = name_length(*argv);
+        if (len > 0 && (*argv)[len] == '=')
+            env_set(*argv, len);
+        else if (len == 0 || (*argv)[len] != '\0')
+        {
+            printf("export: %s: not a valid identifier\n", *argv);
+            status = 1;
+        }
+        /* export NAME: every variable is exported already */
+    }
+    return status;
+}
+
+/*
+ * do_unset - Execute the builtin unset command: unset NAME ...
+ */
+int do_unset(char **argv)
+{
+    for (argv++; *argv != NULL; argv++)
+        env_unset(*argv);
+    return 0;
+}
@@ -0,0 +1,21 @@
+/* The shell's environment: export, unset, NAME=value cmd and $NAME.
+ * Variables are kept in a hash table along with the envp array that is
+ * passed to execve, which is only rebuilt after a variable is added or
+ * removed. */
+
+typedef struct env env_t;
+
+extern env_t *env; /* the current environment (tsh -S: the session's) */
+
+void env_init(char **envp);
+env_t *env_share(env_t *e);
+void env_release(env_t *e);
+int env_assignment(const char *word);
+const char *env_get(const char *name, size_t len);
+void env_set(const char *var, size_t namelen);
+void env_unset(const char *name);
+char **env_envp(void);
+char **env_with(char **assign, int n);
+int env_expand(const char *src, size_t len, char *dst, size_t size);
+int do_export(char **argv);
+int do_unset(char **argv);
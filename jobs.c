@@ -1,8 +1,14 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 #include <sys/wait.h>
 #include "jobs.h"
+#include "deadline.h"
+#include "snapshot.h"
+#include "perfstat.h"
+#include "reaper.h"
+#include "server.h"
 
 /* TODO: Nothing! */
 /*       But you will call functions in this file. */
@@ -10,17 +16,34 @@
 
 extern int verbose;
 int nextjid;
-job_t jobs[MAXJOBS]; /* The job list */
+static job_t joblist[MAXJOBS]; /* The job list */
+job_t *jobs = joblist; /* (tsh -S points this at each session's list) */
 
 /***********************************************
  * Helper routines that manipulate the job list
  **********************************************/
 
-/* clearjob - Clear the entries in a job struct */
+/* The jid index is kept in the list itself, so that every list (one per
+ * session with tsh -S) has its own: bucket jid % MAXJOBS starts at the
+ * jidhead of that slot and runs through jidnext, in the order the jobs
+ * were added.  A bucket rarely holds more than one job, since jids only
+ * go past MAXJOBS, or repeat, after nextjid wraps. */
+
+/* jid_bucket - The head link of jid's bucket in the index */
+static int *jid_bucket(job_t *jobs, int jid)
+{
+    return &jobs[jid % MAXJOBS].jidhead;
+}
+
+/* clearjob - Clear the entries in a job struct (but not the jid index) */
 void clearjob(job_t *job) {
     job->pid = 0;
     job->jid = 0;
     job->state = UNDEF;
+    job->deadline = NULL;
+    job->snap = -1;
+    job->perf = -1;
+    job->jidnext = 0;
     job->cmdline[0] = '\0';
 }
 
@@ -28,7 +51,11 @@ void clearjob(job_t *job) {
 void initjobs(job_t *jobs) {
     int i;
     nextjid = 1;
-    for (i = 0; i < MAXJOBS; i++) clearjob(&jobs[i]);
+    for (i = 0; i < MAXJOBS; i++)
+    {
+        clearjob(&jobs[i]);
+        jobs[i].jidhead = 0;
+    }
 }
 
 /* maxjid - Returns largest allocated job ID */
@@ -45,7 +72,7 @@ int maxjid(job_t *jobs)
 /* addjob - Add a job to the job list */
 int addjob(job_t *jobs, pid_t pid, int state, char *cmdline) 
 {
-    int i;
+    int i, *link;
     
     if (pid < 1)
     return 0;
@@ -58,7 +85,15 @@ int addjob(job_t *jobs, pid_t pid, int state, char *cmdline)
             jobs[i].state = state;
             jobs[i].jid = nextjid++;
             if (nextjid > MAXJOBS) nextjid = 1;
-            strcpy(jobs[i].cmdline, cmdline);
+            for (link = jid_bucket(jobs, jobs[i].jid); *link != 0; link = &jobs[*link - 1].jidnext)
+                ;
+            *link = i + 1;
+            // A long list is cut short, still ending in its newline
+            snprintf(jobs[i].cmdline, MAXLINE, "%s", cmdline);
+            if (strlen(cmdline) >= MAXLINE)
+                strcpy(jobs[i].cmdline + MAXLINE - 5, "...\n");
+            snapshot_add(&jobs[i]);
+            reaper_add(pid);
               if(verbose)
             {
                 printf("Added job [%d] %d %s\n", 
@@ -74,7 +109,7 @@ int addjob(job_t *jobs, pid_t pid, int state, char *cmdline)
 /* deletejob - Delete a job whose PID=pid from the job list */
 int deletejob(job_t *jobs, pid_t pid) 
 {
-    int i;
+    int i, *link;
 
     if (pid < 1) return 0;
 
@@ -82,6 +117,15 @@ int deletejob(job_t *jobs, pid_t pid)
     {
         if (jobs[i].pid == pid) 
         {
+            for (link = jid_bucket(jobs, jobs[i].jid); *link != i + 1; link = &jobs[*link - 1].jidnext)
+                ;
+            *link = jobs[i].jidnext;
+            if (jobs[i].deadline != NULL)
+                deadline_cancel(&jobs[i]);
+            snapshot_drop(&jobs[i]);
+            if (jobs[i].perf >= 0)
+                perf_close(&jobs[i]);
+            reaper_drop(pid);
             clearjob(&jobs[i]);
             nextjid = maxjid(jobs)+1;
             return 1;
@@ -115,8 +159,8 @@ job_t *getjobjid(job_t *jobs, int jid)
     int i;
 
     if (jid < 1) return NULL;
-    for (i = 0; i < MAXJOBS; i++)
-        if (jobs[i].jid == jid) return &jobs[i];
+    for (i = *jid_bucket(jobs, jid); i != 0; i = jobs[i - 1].jidnext)
+        if (jobs[i - 1].jid == jid) return &jobs[i - 1];
     return NULL;
 }
 
@@ -134,32 +178,101 @@ int pid2jid(pid_t pid)
     return 0;
 }
 
+/* listjob - Render one job into buf, returning the number of bytes used */
+static int listjob(char *buf, size_t size, job_t *job, int i, int opts)
+{
+    const char *state;
+    long left;
+    int n;
+
+    if (opts & LIST_PIDS)
+        return snprintf(buf, size, "%d\n", job->pid);
+
+    switch (job->state) 
+    {
+        case BG: 
+            state = "Running ";
+            break;
+        case FG: 
+            state = "Foreground ";
+            break;
+        case ST: 
+            state = "Stopped ";
+        break;
+        case PD: 
+            state = "Pending ";
+        break;
+    default:
+        state = NULL;
+    }
+    if (state != NULL)
+        n = snprintf(buf, size, "[%d] (%d) %s", job->jid, job->pid, state);
+    else
+        n = snprintf(buf, size, "[%d] (%d) listjobs: Internal error: job[%d].state=%d ", 
+                     job->jid, job->pid, i, job->state);
+
+    if ((opts & LIST_TIMES) && job->deadline != NULL)
+    {
+        if ((left = deadline_left(job)) >= 0)
+            n += snprintf(buf + n, size - n, "(%ld.%02lds left) ",
+                          left / 1000, left % 1000 / 10);
+        else
+            n += snprintf(buf + n, size - n, "(timed out) ");
+    }
+    return n + snprintf(buf + n, size - n, "%s", job->cmdline);
+}
+
+/* listed - listjob for jobs[i] if the listing's filters take it, else 0 */
+static int listed(char *buf, size_t size, job_t *jobs, int i, int opts, const char *want)
+{
+    job_t *job = &jobs[i];
+
+    if (want != NULL && (job->jid > MAXJOBS + 1 || !want[job->jid]))
+        return 0;
+    if ((opts & LIST_RUNNING) && job->state != BG && job->state != FG)
+        return 0;
+    if ((opts & LIST_STOPPED) && job->state != ST)
+        return 0;
+    return listjob(buf, size, job, i, opts);
+}
+
 /* listjobs - Print the job list */
 void listjobs(job_t *jobs) 
 {
-    int i;
-    
-    for (i = 0; i < MAXJOBS; i++) 
+    listjobs_opt(jobs, 0, NULL);
+}
+
+/*
+ * listjobs_opt - Print the job list in jid order.  opts selects LIST_*
+ *    filters and formats; if want is not NULL, only jobs whose jid has
+ *    want[jid] set are listed.  The whole listing goes out in one write.
+ */
+void listjobs_opt(job_t *jobs, int opts, const char *want) 
+{
+    static char buf[MAXJOBS * (MAXLINE + 64)];
+    size_t len = 0;
+    ssize_t n;
+    int i, jid;
+
+    /* Straight from the jid index.  Jids only pass MAXJOBS+1 after
+     * nextjid has wrapped (see deletejob), and those come last; jobs
+     * that share a jid come in the order they were added. */
+    for (jid = 1; jid <= MAXJOBS + 1; jid++)
+        for (i = *jid_bucket(jobs, jid); i != 0; i = jobs[i - 1].jidnext)
+            if (jobs[i - 1].jid == jid)
+                len += listed(buf + len, sizeof(buf) - len, jobs, i - 1, opts, want);
+    for (jid = 0; jid < MAXJOBS; jid++)
+        for (i = jobs[jid].jidhead; i != 0; i = jobs[i - 1].jidnext)
+            if (jobs[i - 1].jid > MAXJOBS + 1)
+                len += listed(buf + len, sizeof(buf) - len, jobs, i - 1, opts, want);
+
+    fflush(stdout); /* anything printed earlier comes first */
+    if (serving)
     {
-        if (jobs[i].pid != 0) 
-        {
-            printf("[%d] (%d) ", jobs[i].jid, jobs[i].pid);
-            switch (jobs[i].state) 
-            {
-                case BG: 
-                    printf("Running ");
-                    break;
-                case FG: 
-                    printf("Foreground ");
-                    break;
-                case ST: 
-                    printf("Stopped ");
-                break;
-            default:
-                printf("listjobs: Internal error: job[%d].state=%d ", 
-                   i, jobs[i].state);
-            }
-            printf("%s", jobs[i].cmdline);
-        }
+        fwrite(buf, 1, len, stdout); /* the session's queue (server.c) */
+        return;
     }
+    for (i = 0; i < (int) len; i += n)
+        if ((n = write(STDOUT_FILENO, buf + i, len - i)) <= 0)
+            break;
 }
@@ -8,6 +8,17 @@
 #define FG 1    /* running in foreground */
 #define BG 2    /* running in background */
 #define ST 3    /* stopped */
+#define PD 4    /* pending: waiting for other jobs (after) */
+
+/* A job's place on the deadline timer wheel (deadline.c).  It is kept in
+ * the job, so that reaping a job never has to free one. */
+struct deadline
+{
+    struct deadline *next, *prev;
+    unsigned long expires; /* tick */
+    pid_t pid;             /* job (and process group) to signal */
+    int stage;
+};
 
 /* The job struct */
 typedef struct 
@@ -15,10 +26,18 @@ typedef struct
     pid_t pid;              /* job PID */
     int jid;                /* job ID [1, 2, ...] */
     int state;              /* UNDEF, BG, FG, or ST */
+    struct deadline *deadline; /* pending timeout (&timer), or NULL */
+    struct deadline timer;  /* the storage for it */
+    int snap;               /* record in the published table (snapshot.c), or -1 */
+    int perf;               /* its event counters (perfstat.c), or -1 */
+    int jidhead;            /* jid index: slot + 1 of the first job whose jid
+                               % MAXJOBS is this slot's number, 0 if none */
+    int jidnext;            /* jid index: slot + 1 of the next such job, or 0 */
     char cmdline[MAXLINE];  /* command line */
 } job_t;
 
-extern job_t jobs[MAXJOBS]; 
+extern job_t *jobs;   /* the current job list */
+extern int nextjid;  /* next job ID to allocate in it */
 
 void clearjob(job_t *job);
 void initjobs(job_t *jobs);
@@ -29,5 +48,12 @@ pid_t fgpid(job_t *jobs);
 job_t *getjobpid(job_t *jobs, pid_t pid);
 job_t *getjobjid(job_t *jobs, int jid); 
 int pid2jid(pid_t pid); 
+/* listjobs_opt options */
+#define LIST_RUNNING 1  /* running jobs only (jobs -r) */
+#define LIST_STOPPED 2  /* stopped jobs only (jobs -s) */
+#define LIST_PIDS    4  /* just the PIDs (jobs -p) */
+#define LIST_TIMES   8  /* time left before timeouts (jobs -l) */
+
 void listjobs(job_t *jobs);
+void listjobs_opt(job_t *jobs, int opts, const char *want);
 
@@ -0,0 +1,58 @@
+/* 
+ * myburn.c - A CPU load for testing your tiny shell
+ * 
+ * usage: myburn <ms> [<duty>]
+ * Burns CPU for <ms> milliseconds.  With <duty> (1-100, default 100)
+ * it spins only that percentage of each 10 ms period and sleeps for
+ * the rest.
+ *
+ */
+#include <stdio.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define PERIOD 10 /* ms */
+
+/* now - Milliseconds on the monotonic clock */
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+int main(int argc, char **argv) 
+{
+    double start, end, t, busy;
+    int ms, duty = 100;
+    struct timespec rest;
+
+    if (argc != 2 && argc != 3) {
+	fprintf(stderr, "Usage: %s <ms> [<duty>]\n", argv[0]);
+	exit(0);
+    }
+    ms = atoi(argv[1]);
+    if (argc == 3)
+	duty = atoi(argv[2]);
+    if (duty < 1 || duty > 100) {
+	fprintf(stderr, "%s: duty must be 1-100\n", argv[0]);
+	exit(0);
+    }
+
+    busy = PERIOD * duty / 100.0;
+    start = now();
+    end = start + ms;
+    for (t = start; t < end; t += PERIOD) {
+	while (now() < t + busy && now() < end)
+	    ; /* spin */
+	if (duty < 100 && t + PERIOD < end) {
+	    rest.tv_sec = 0;
+	    rest.tv_nsec = (long) ((t + PERIOD - now()) * 1e6);
+	    if (rest.tv_nsec > 0)
+		nanosleep(&rest, NULL);
+	}
+    }
+    exit(0);
+}
@@ -0,0 +1,62 @@
+/* 
+ * myfan.c - A process-count load for testing your tiny shell
+ * 
+ * usage: myfan <n> [<ms>] [<fanout>]
+ * Forks a tree of <n> descendants, each with up to <fanout> children
+ * (default 2).  Every process sleeps for <ms> milliseconds, then waits
+ * for its children before it exits.
+ *
+ */
+#include <stdio.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+/*
+ * grow - Give the calling process n descendants in all, spread as
+ *    evenly as possible over up to fanout children
+ */
+static void grow(int n, int fanout)
+{
+    int i, share;
+
+    for (i = 0; i < fanout && n > 0; i++) {
+	share = (n + fanout - i - 1) / (fanout - i); /* its subtree */
+	n -= share;
+	if (fork() == 0) {
+	    n = share - 1;
+	    i = -1; /* now the child fills in its own subtree */
+	}
+    }
+}
+
+int main(int argc, char **argv) 
+{
+    int n, ms = 0, fanout = 2;
+    struct timespec hold;
+
+    if (argc < 2 || argc > 4) {
+	fprintf(stderr, "Usage: %s <n> [<ms>] [<fanout>]\n", argv[0]);
+	exit(0);
+    }
+    n = atoi(argv[1]);
+    if (argc >= 3)
+	ms = atoi(argv[2]);
+    if (argc == 4)
+	fanout = atoi(argv[3]);
+    if (fanout < 1) {
+	fprintf(stderr, "%s: fanout must be at least 1\n", argv[0]);
+	exit(0);
+    }
+
+    grow(n, fanout);
+
+    hold.tv_sec = ms / 1000;
+    hold.tv_nsec = (ms % 1000) * 1000000L;
+    nanosleep(&hold, NULL);
+    while (wait(NULL) > 0)
+	;
+    exit(0);
+}
@@ -0,0 +1,61 @@
+/* 
+ * myflood.c - An output load for testing your tiny shell
+ * 
+ * usage: myflood <MB/s> <ms>
+ * Writes lines of text to stdout at <MB/s> megabytes a second for <ms>
+ * milliseconds.  A rate of 0 writes as fast as the reader takes it.
+ *
+ */
+#include <stdio.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define CHUNK 4096 /* bytes per write */
+
+/* now - Milliseconds on the monotonic clock */
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+int main(int argc, char **argv) 
+{
+    char buf[CHUNK];
+    double rate, start, due;
+    long long sent = 0;
+    int i, ms;
+    struct timespec rest;
+
+    if (argc != 3) {
+	fprintf(stderr, "Usage: %s <MB/s> <ms>\n", argv[0]);
+	exit(0);
+    }
+    rate = atof(argv[1]) * 1e6 / 1e3; /* bytes per ms */
+    ms = atoi(argv[2]);
+
+    /* 63 characters and a newline per line */
+    for (i = 0; i < CHUNK; i++)
+	buf[i] = (i % 64 == 63) ? '\n' : 'a' + i % 64 % 26;
+
+    start = now();
+    while (now() < start + ms) {
+	if (write(STDOUT_FILENO, buf, CHUNK) < 0)
+	    exit(1);
+	sent += CHUNK;
+	/* Ahead of the rate: wait until this much is due */
+	if (rate > 0 && (due = start + sent / rate) > now()) {
+	    if (due > start + ms)
+		due = start + ms;
+	    due -= now();
+	    rest.tv_sec = (time_t) (due / 1e3);
+	    rest.tv_nsec = (long) ((due - rest.tv_sec * 1e3) * 1e6);
+	    nanosleep(&rest, NULL);
+	}
+    }
+    exit(0);
+}
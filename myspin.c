@@ -2,12 +2,13 @@
  * myspin.c - A handy program for testing your tiny shell 
  * 
  * usage: myspin <n>
- * Sleeps for <n> seconds in 1-second chunks.
+ * Sleeps for <n> seconds in 1-second chunks (see timescale.h).
  *
  */
 #include <stdio.h>
 #include <unistd.h>
 #include <stdlib.h>
+#include "timescale.h"
 
 int main(int argc, char **argv) 
 {
@@ -19,6 +20,6 @@ int main(int argc, char **argv)
     }
     secs = atoi(argv[1]);
     for (i=0; i < secs; i++)
-	sleep(1);
+	tick();
     exit(0);
 }
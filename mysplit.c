@@ -2,11 +2,12 @@
  * mysplit.c - Another handy routine for testing your tiny shell
  * 
  * usage: mysplit <n>
- * Fork a child that spins for <n> seconds in 1-second chunks.
+ * Fork a child that spins for <n> seconds in 1-second chunks (see timescale.h).
  */
 #include <stdio.h>
 #include <unistd.h>
 #include <stdlib.h>
+#include "timescale.h"
 #include <sys/types.h>
 #include <sys/wait.h>
 #include <signal.h>
@@ -24,7 +25,7 @@ int main(int argc, char **argv)
 
     if (fork() == 0) { /* child */
 	for (i=0; i < secs; i++)
-	    sleep(1);
+	    tick();
 	exit(0);
     }
 
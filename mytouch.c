@@ -0,0 +1,44 @@
+/* 
+ * mytouch.c - A memory load for testing your tiny shell
+ * 
+ * usage: mytouch <MiB> [<ms>]
+ * Allocates <MiB> mebibytes, writes to every page so that each one is
+ * really backed by memory, then holds on to it for <ms> milliseconds.
+ *
+ */
+#include <stdio.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <time.h>
+#include <sys/mman.h>
+
+int main(int argc, char **argv) 
+{
+    size_t size, i;
+    long page;
+    char *mem;
+    int ms = 0;
+    struct timespec hold;
+
+    if (argc != 2 && argc != 3) {
+	fprintf(stderr, "Usage: %s <MiB> [<ms>]\n", argv[0]);
+	exit(0);
+    }
+    size = (size_t) atol(argv[1]) << 20;
+    if (argc == 3)
+	ms = atoi(argv[2]);
+
+    mem = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mem == MAP_FAILED) {
+	fprintf(stderr, "%s: can't map %s MiB\n", argv[0], argv[1]);
+	exit(1);
+    }
+    page = sysconf(_SC_PAGESIZE);
+    for (i = 0; i < size; i += page)
+	mem[i] = 1;
+
+    hold.tv_sec = ms / 1000;
+    hold.tv_nsec = (ms % 1000) * 1000000L;
+    nanosleep(&hold, NULL);
+    exit(0);
+}
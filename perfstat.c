@@ -0,0 +1,352 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include "jobs.h"
+#include "wrappers.h"
+#include "perfstat.h"
+
+/* With -e every job gets a group of counters, opened by the shell on the
+ * job's PID with inherit set, so that whatever the job forks is counted
+ * too.  The child must not exec before they exist, or a short job could
+ * be over before it is watched, so it waits on a pipe (the gate) that
+ * the shell closes once they are open.  Without -e none of this
+ * happens: launching a job costs what it always did.
+ *
+ * A job's counters live in the group job->perf.  When the job is
+ * reaped, deletejob calls perf_close (in the SIGCHLD handler, which is
+ * fine: it only reads and closes descriptors), which keeps the final
+ * counts in a small ring for perfstat to show later. */
+
+int perfstat = 0;
+
+/* What is counted: the hardware events first, so that one of them leads
+ * the group when the machine has a PMU */
+static const struct
+{
+    const char *name;
+    unsigned type;
+    unsigned long long config;
+} events[PERF_EVENTS] = {
+    {"cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+    {"instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+    {"task-clock", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK},
+    {"context-switches", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES},
+    {"page-faults", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS},
+};
+#define CYCLES       0
+#define INSTRUCTIONS 1
+#define TASK_CLOCK   2
+
+static int usable[PERF_EVENTS]; /* the event can be counted here */
+static int useronly;            /* perf_event_paranoid only allows user space */
+
+/* The counters of a running job */
+typedef struct
+{
+    int used;
+    job_t *list;                /* the job list it is in */
+    int fd[PERF_EVENTS];        /* -1 for events not counted */
+} group_t;
+
+/* Counts, as read */
+typedef struct
+{
+    job_t *list;                /* the job list it was in, NULL if forgotten */
+    int jid;
+    pid_t pid;
+    unsigned long long count[PERF_EVENTS];
+    int pct[PERF_EVENTS];       /* percent of the time it was counted, 0 if never */
+    char cmdline[MAXLINE];
+} counts_t;
+
+static group_t live[PERF_LIVE];
+static counts_t done[PERF_DONE]; /* ring of the last finished jobs */
+static unsigned ndone;           /* records ever written to it */
+
+/* open_event - Start counting event i of process pid, in group (or a new
+ * group if group is -1) */
+static int open_event(int i, pid_t pid, int group)
+{
+    struct perf_event_attr attr;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = events[i].type;
+    attr.config = events[i].config;
+    attr.inherit = 1;
+    attr.exclude_kernel = useronly;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    return syscall(SYS_perf_event_open, &attr, pid, -1, group, PERF_FLAG_FD_CLOEXEC);
+}
+
+/*
+ * perf_init - Find out which events can be counted (tsh -e).  Counting
+ *    is turned off again if none can.
+ */
+void perf_init(void)
+{
+    int i, fd, n = 0;
+
+    for (i = 0; i < PERF_EVENTS; i++)
+    {
+        if ((fd = open_event(i, 0, -1)) < 0 && errno == EACCES && !useronly)
+        {
+            useronly = 1;
+            fd = open_event(i, 0, -1);
+        }
+        if (fd >= 0)
+        {
+            usable[i] = 1;
+            close(fd);
+            n++;
+        }
+    }
+    for (i = 0; i < PERF_LIVE; i++)
+        live[i].used = 0;
+    if (n == 0)
+    {
+        printf("perf_event_open: %s (job events are not counted)\n", strerror(errno));
+        perfstat = 0;
+        return;
+    }
+    perfstat = 1;
+}
+
+/*
+ * perf_gate - Before forking a job: the pipe its child waits on
+ */
+void perf_gate(int gate[2])
+{
+    if (pipe(gate) < 0)
+        gate[0] = gate[1] = -1;
+}
+
+/*
+ * perf_wait - In the job's child: wait until the shell has opened the
+ *    counters (perf_attach closes the gate)
+ */
+void perf_wait(int gate[2])
+{
+    char c;
+
+    if (gate[0] < 0)
+        return;
+    close(gate[1]);
+    while (read(gate[0], &c, 1) < 0 && errno == EINTR)
+        ;
+    close(gate[0]);
+}
+
+/*
+ * perf_attach - Open a job's counters and let its child go on.  job is
+ *    NULL if it could not be added to the job list.
+ */
+void perf_attach(job_t *job, int gate[2])
+{
+    int slot, i, leader = -1;
+    group_t *g;
+
+    for (slot = 0; job != NULL && slot < PERF_LIVE && live[slot].used; slot++)
+        ;
+    if (job != NULL && slot < PERF_LIVE)
+    {
+        g = &live[slot];
+        for (i = 0; i < PERF_EVENTS; i++)
+        {
+            g->fd[i] = usable[i] ? open_event(i, job->pid, leader) : -1;
+            if (leader < 0)
+                leader = g->fd[i];
+        }
+        if (leader >= 0)
+        {
+            g->used = 1;
+            g->list = jobs;
+            job->perf = slot;
+        }
+    }
+    if (gate[0] >= 0)
+    {
+        close(gate[0]);
+        close(gate[1]);
+    }
+}
+
+/* read_counts - Read a group's counters into c, scaling each one up if
+ * it shared the PMU with other events and so was not always counting */
+static void read_counts(group_t *g, counts_t *c)
+{
+    unsigned long long v[3]; /* value, time enabled, time running */
+    int i;
+
+    for (i = 0; i < PERF_EVENTS; i++)
+    {
+        c->count[i] = 0;
+        c->pct[i] = 0;
+        if (g->fd[i] < 0 || read(g->fd[i], v, sizeof(v)) != sizeof(v) || v[2] == 0)
+            continue;
+        c->count[i] = (v[2] < v[1]) ? (unsigned long long) ((double) v[0] * v[1] / v[2]) : v[0];
+        c->pct[i] = (v[2] < v[1]) ? (int) (100.0 * v[2] / v[1]) : 100;
+        if (c->pct[i] == 0)
+            c->pct[i] = 1;
+    }
+}
+
+/*
+ * perf_close - Keep the final counts of a job that is being deleted and
+ *    close its counters
+ */
+void perf_close(job_t *job)
+{
+    group_t *g = &live[job->perf];
+    counts_t *c = &done[ndone++ % PERF_DONE];
+    int i;
+
+    read_counts(g, c);
+    c->list = g->list;
+    c->jid = job->jid;
+    c->pid = job->pid;
+    strcpy(c->cmdline, job->cmdline);
+    for (i = 0; i < PERF_EVENTS; i++)
+    {
+        if (g->fd[i] >= 0)
+            close(g->fd[i]);
+    }
+    g->used = 0;
+    job->perf = -1;
+}
+
+/*
+ * perf_forget - Drop the counts kept for a job list's finished jobs
+ *    (its session is closing)
+ */
+void perf_forget(job_t *list)
+{
+    int i;
+
+    for (i = 0; i < PERF_DONE; i++)
+    {
+        if (done[i].list == list)
+            done[i].list = NULL;
+    }
+}
+
+/* show - Print a job's counts, in the manner of perf stat */
+static void show(counts_t *c, const char *state)
+{
+    int i;
+
+    printf("[%d] (%d) %s %s", c->jid, c->pid, state, c->cmdline);
+    for (i = 0; i < PERF_EVENTS; i++)
+    {
+        if (!usable[i])
+            continue;
+        if (c->pct[i] == 0)
+            printf("  %16s      %s", "<not counted>", events[i].name);
+        else if (i == TASK_CLOCK)
+            printf("  %16.2f msec %s", c->count[i] / 1e6, events[i].name);
+        else
+            printf("  %16llu      %s", c->count[i], events[i].name);
+        if (i == INSTRUCTIONS && c->pct[i] > 0 && c->count[CYCLES] > 0)
+            printf("  # %.2f per cycle", (double) c->count[i] / c->count[CYCLES]);
+        if (c->pct[i] > 0 && c->pct[i] < 100)
+            printf("  (%d%% counted)", c->pct[i]);
+        printf("\n");
+    }
+}
+
+/* show_live - Print the counts so far of a job that is still running */
+static void show_live(job_t *job)
+{
+    counts_t c;
+    const char *state = (job->state == ST) ? "Stopped" : (job->state == PD) ? "Pending" : "Running";
+
+    read_counts(&live[job->perf], &c);
+    c.jid = job->jid;
+    c.pid = job->pid;
+    strcpy(c.cmdline, job->cmdline);
+    show(&c, state);
+}
+
+/* find_done - The latest finished job of this list with jid (or pid) */
+static counts_t *find_done(int jid, pid_t pid)
+{
+    unsigned n;
+    counts_t *c;
+
+    for (n = ndone; n > 0 && n + PERF_DONE > ndone; n--)
+    {
+        c = &done[(n - 1) % PERF_DONE];
+        if (c->list == jobs && (jid ? c->jid == jid : c->pid == pid))
+            return c;
+    }
+    return NULL;
+}
+
+/*
+ * do_perfstat - Execute the builtin perfstat command:
+ *    perfstat [%jobid | pid ...]
+ * With no arguments, show every job being counted, then the finished
+ * ones that are still kept, latest first.
+ */
+void do_perfstat(char **argv)
+{
+    sigset_t mask_all, prev_all;
+    job_t *job;
+    counts_t *c;
+    unsigned n;
+    int i, byjid, jid;
+    pid_t pid;
+    char *end;
+
+    if (!perfstat)
+    {
+        printf("perfstat: job events are only counted with tsh -e\n");
+        return;
+    }
+
+    // The SIGCHLD handler adds to the finished jobs
+    Sigfillset(&mask_all);
+    Sigprocmask(SIG_BLOCK, &mask_all, &prev_all);
+    if (argv[1] == NULL)
+    {
+        for (i = 0; i < MAXJOBS; i++)
+        {
+            if (jobs[i].pid != 0 && jobs[i].perf >= 0)
+                show_live(&jobs[i]);
+        }
+        for (n = ndone; n > 0 && n + PERF_DONE > ndone; n--)
+        {
+            if ((c = &done[(n - 1) % PERF_DONE])->list == jobs)
+                show(c, "Done");
+        }
+    }
+    for (argv++; *argv != NULL; argv++)
+    {
+        jid = pid = 0;
+        if ((byjid = (**argv == '%')))
+            jid = strtol(*argv + 1, &end, 10);
+        else
+            pid = strtol(*argv, &end, 10);
+        if (end == *argv + byjid || *end != '\0' || (jid <= 0 && pid <= 0))
+        {
+            printf("perfstat: argument must be a PID or %%jobid\n");
+            continue;
+        }
+        job = byjid ? getjobjid(jobs, jid) : getjobpid(jobs, pid);
+        if (job != NULL && job->perf >= 0)
+            show_live(job);
+        else if ((c = find_done(jid, pid)) != NULL)
+            show(c, "Done");
+        else if (byjid)
+            printf("%s: No such job\n", *argv);
+        else
+            printf("(%s): No such process\n", *argv);
+    }
+    Sigprocmask(SIG_SETMASK, &prev_all, NULL);
+}
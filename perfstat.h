@@ -0,0 +1,18 @@
+/* tsh -e: count each job's CPU events with perf_event_open (the perfstat
+ * builtin shows them).  Counting starts before the job execs and takes
+ * in everything it forks; the final counts are read when it is reaped.
+ * Without a PMU (as in most VMs) only the software events are counted. */
+
+#define PERF_EVENTS 5  /* events counted per job, at most */
+#define PERF_LIVE   64 /* jobs counted at once */
+#define PERF_DONE   16 /* finished jobs whose counts are kept */
+
+extern int perfstat; /* true with -e */
+
+void perf_init(void);
+void perf_gate(int gate[2]);
+void perf_wait(int gate[2]);
+void perf_attach(job_t *job, int gate[2]);
+void perf_close(job_t *job);
+void perf_forget(job_t *list);
+void do_perfstat(char **argv);
@@ -0,0 +1,650 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/prctl.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include "wrappers.h"
+#include "reaper.h"
+
+/* A job's tree is kept track of in two parts.  Most of it stays in the
+ * job's process group, and the kernel already keeps that set: kill(-job,
+ * 0) says whether any of it is left, whatever its size, and reaping one
+ * of its orphans takes a getpgid to know whose it is.  Nothing per
+ * process is stored for these.
+ *
+ * Stragglers, the processes of a job that have left its group (setsid,
+ * setpgid), go into a fixed open-addressing table (linear probing, no
+ * tombstones, as in env.c) along with every job's leader.  The table
+ * needs no allocation, because it is used in the SIGCHLD handler.  Only
+ * the stragglers that are the shell's children hold a job open: the
+ * others are reaped by their parents, unseen.
+ *
+ * Members are picked up as the job's processes are reaped, never by
+ * signals.  When a leader dies, when a job's group empties with no
+ * stragglers left, and when a straggler dies (at most once every
+ * SCAN_GAP_MS), the shell's own list of children is read (adopt).  An
+ * orphan does not say where it came from, so any child of the shell
+ * that nobody claims is put down to that job.  Two jobs leaving strays
+ * at the same moment can get each other's.
+ *
+ * Stragglers that still have a parent are only found by scanning all of
+ * /proc (a survey), which costs as much as there are processes on the
+ * system.  One is made only when the shell reaps a child that is not a
+ * leader, and then no more often than about a tenth of the time: a
+ * process outside every job's group is one of a job's stragglers if the
+ * first claimed process on its way up the tree (by ppid) is that job's.
+ *
+ * Signals go to the job's group, then to its stragglers in the table.
+ * The job remembers the signal, and a member found later gets it too:
+ * a straggler whose parent the signal kills is only found once it is
+ * the shell's, after the signal went out.
+ *
+ * Adopting and scanning only make system calls, on static buffers: they
+ * run in signal handlers. */
+
+#define LIVE          -1 /* status of a leader that has not been reaped */
+#define DENTS_BUFSIZE (64 * 1024)
+#define STAT_BUFSIZE  512
+#define PROC_SLOTS    (2 * REAPER_PROCS)
+#define SCAN_GAP_MS   10
+#define SCAN_SHARE    10 /* a survey waits this many times what it took */
+#define STR(x)        #x
+#define XSTR(x)       STR(x)
+
+/* A leader or a straggler */
+typedef struct
+{
+    pid_t pid;       /* 0 if the slot is empty */
+    pid_t job;       /* the leader of its job (itself, for a leader) */
+    int members;     /* leader: its stragglers in the table */
+    int strays;      /* leader: those of them that are the shell's children */
+    int status;      /* leader: its wait status once reaped, else LIVE */
+    int released;    /* leader: its job list is gone (reaper_release) */
+    int sig;         /* leader: the signal sent to the job, 0 if none */
+    int child;       /* straggler: it is the shell's child */
+    unsigned seen;   /* straggler: the survey that last saw it */
+} member_t;
+
+/* A process, as a scan of /proc saw it */
+typedef struct
+{
+    pid_t pid, ppid, pgid;
+    pid_t job;       /* owner_of: 0 not yet worked out, -1 nobody's */
+} proc_t;
+
+static member_t table[REAPER_SLOTS];
+static int used;                  /* slots in use */
+static int loose;                 /* stragglers that are not our children */
+static unsigned surveys;          /* surveys made */
+static int truncated;             /* the last scan missed processes */
+static int subreaping;            /* the prctl worked */
+static pid_t shell;               /* the parent of every orphan */
+static pid_t lastpid, lastpgid, lastjob; /* what reaper_wait reaped last */
+static long long nextscan;        /* CLOCK_MONOTONIC ms a survey may run from */
+static long long lastadopt;       /* CLOCK_MONOTONIC ms of the last adopt */
+static char kids[48];             /* the shell's list of children in /proc */
+
+static proc_t procs[REAPER_PROCS];
+static int nprocs;
+static int byid[PROC_SLOTS];      /* index + 1 into procs by pid, 0 if empty */
+
+/* home - Where the probe for pid starts in a table of size slots */
+static size_t home(pid_t pid, size_t size)
+{
+    return (((unsigned) pid * 2654435769u) >> 16) & (size - 1);
+}
+
+/* find - Slot holding pid, or the empty slot where it would go */
+static size_t find(pid_t pid)
+{
+    size_t i = home(pid, REAPER_SLOTS);
+
+    while (table[i].pid != 0 && table[i].pid != pid)
+        i = (i + 1) & (REAPER_SLOTS - 1);
+    return i;
+}
+
+/* insert - The slot for pid, taken if it was free.  NULL if the table is
+ * too full to take it. */
+static member_t *insert(pid_t pid)
+{
+    size_t i = find(pid);
+
+    if (table[i].pid == 0)
+    {
+        if (used >= REAPER_SLOTS / 4 * 3)
+            return NULL;
+        used++;
+    }
+    table[i].pid = pid;
+    table[i].members = 0;
+    table[i].strays = 0;
+    table[i].status = LIVE;
+    table[i].released = 0;
+    table[i].sig = 0;
+    return &table[i];
+}
+
+/* unlink_slot - Empty slot i */
+static void unlink_slot(size_t i)
+{
+    size_t j, h;
+
+    table[i].pid = 0;
+    used--;
+
+    /* Shift back later entries of the run that could no longer be found */
+    for (j = (i + 1) & (REAPER_SLOTS - 1); table[j].pid != 0; j = (j + 1) & (REAPER_SLOTS - 1))
+    {
+        h = home(table[j].pid, REAPER_SLOTS);
+        if (((j - h) & (REAPER_SLOTS - 1)) >= ((j - i) & (REAPER_SLOTS - 1)))
+        {
+            table[i] = table[j];
+            table[j].pid = 0;
+            i = j;
+        }
+    }
+}
+
+/* leader - The table entry of job's leader, or NULL */
+static member_t *leader(pid_t job)
+{
+    member_t *l = &table[find(job)];
+
+    return (job > 0 && l->pid == job && l->job == job) ? l : NULL;
+}
+
+/* claim - The job a process is known to be part of: as a leader or a
+ * straggler, or by being in a leader's group.  0 if none. */
+static pid_t claim(pid_t pid, pid_t pgid)
+{
+    member_t *m = &table[find(pid)];
+
+    if (m->pid == pid)
+        return m->job;
+    return (leader(pgid) != NULL) ? pgid : 0;
+}
+
+/* group_alive - Whether anything is left in job's process group */
+static int group_alive(pid_t job)
+{
+    return kill(-job, 0) == 0 || errno == EPERM;
+}
+
+/* parse - The number at *s, which is moved past it */
+static pid_t parse(char **s)
+{
+    pid_t n = 0;
+
+    while (**s >= '0' && **s <= '9')
+        n = n * 10 + *(*s)++ - '0';
+    return n;
+}
+
+/* read_stat - Fill in the parent and group of p from /proc/<name>/stat */
+static int read_stat(const char *name, proc_t *p)
+{
+    char path[32], buf[STAT_BUFSIZE], *s;
+    size_t len = strlen(name);
+    ssize_t n;
+    int fd;
+
+    if (len > 16)
+        return -1;
+    memcpy(path, "/proc/", 6);
+    memcpy(path + 6, name, len);
+    memcpy(path + 6 + len, "/stat", 6);
+    if ((fd = open(path, O_RDONLY | O_CLOEXEC)) < 0)
+        return -1;
+    n = read(fd, buf, sizeof(buf) - 1);
+    close(fd);
+
+    /* The command name is in parentheses and may hold anything; then
+     * come the state, the parent and the group */
+    if (n <= 0 || (s = memrchr(buf, ')', n)) == NULL || s + 4 >= buf + n)
+        return -1;
+    buf[n] = '\0';
+    s += 4;
+    p->ppid = parse(&s);
+    s++;
+    p->pgid = parse(&s);
+    p->job = 0;
+    return 0;
+}
+
+/* scan - Read every process in /proc into procs.  Returns how many. */
+static int scan(void)
+{
+    static char buf[DENTS_BUFSIZE];
+    static const char full[] =
+        "tsh: more than " XSTR(REAPER_PROCS) " processes: stragglers among the rest are missed\n";
+    struct dirent64 *d;
+    ssize_t n, pos;
+    char *s;
+    int fd, missed = 0;
+
+    nprocs = 0;
+    if ((fd = open("/proc", O_RDONLY | O_DIRECTORY | O_CLOEXEC)) < 0)
+        return 0;
+    while ((n = getdents64(fd, buf, DENTS_BUFSIZE)) > 0)
+    {
+        for (pos = 0; pos < n; pos += d->d_reclen)
+        {
+            d = (struct dirent64 *) (buf + pos);
+            s = d->d_name;
+            if (*s < '1' || *s > '9')
+                continue;
+            if (nprocs == REAPER_PROCS)
+            {
+                missed = 1;
+                break;
+            }
+            procs[nprocs].pid = parse(&s);
+            if (*s == '\0' && read_stat(d->d_name, &procs[nprocs]) == 0)
+                nprocs++;
+        }
+    }
+    close(fd);
+
+    /* Said once each time it starts happening (write: no stdio here) */
+    if (missed && !truncated)
+        write(STDOUT_FILENO, full, sizeof(full) - 1);
+    truncated = missed;
+    return nprocs;
+}
+
+/* index_of - Where pid is in procs, or -1 */
+static int index_of(pid_t pid)
+{
+    size_t i;
+
+    for (i = home(pid, PROC_SLOTS); byid[i] != 0; i = (i + 1) & (PROC_SLOTS - 1))
+        if (procs[byid[i] - 1].pid == pid)
+            return byid[i] - 1;
+    return -1;
+}
+
+/* owner_of - The job procs[i] is part of: that of the first process on
+ * its way up the tree that is claimed, stopping short of the shell.  -1
+ * if none is. */
+static pid_t owner_of(int i)
+{
+    static int path[REAPER_PROCS];
+    int n = 0;
+    pid_t job = -1;
+
+    while (i >= 0)
+    {
+        if (procs[i].job != 0)
+        {
+            job = procs[i].job;
+            break;
+        }
+        procs[i].job = -1; /* so that a loop in the links ends here */
+        path[n++] = i;
+        if ((job = claim(procs[i].pid, procs[i].pgid)) != 0)
+            break;
+        job = -1;
+        i = (procs[i].ppid == shell) ? -1 : index_of(procs[i].ppid);
+    }
+    while (n > 0)
+        procs[path[--n]].job = job;
+    return job;
+}
+
+/* now_ms - CLOCK_MONOTONIC in milliseconds */
+static long long now_ms(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000LL + ts.tv_nsec / 1000000;
+}
+
+/* enter - Make pid one of job's stragglers, giving it the signal the
+ * job was sent */
+static void enter(pid_t pid, int child, pid_t job)
+{
+    member_t *l = leader(job), *m;
+
+    if (l == NULL || (m = insert(pid)) == NULL)
+        return;
+    m->job = job;
+    m->child = child;
+    m->seen = surveys;
+    l->members++;
+    if (m->child)
+        l->strays++;
+    else
+        loose++;
+    if (l->sig != 0)
+        kill(pid, l->sig);
+}
+
+/* promote - The straggler m has become the shell's child */
+static void promote(member_t *m)
+{
+    member_t *l = leader(m->job);
+
+    if (m->child || l == NULL)
+        return;
+    m->child = 1;
+    loose--;
+    l->strays++;
+}
+
+/* drop_stray - Take the straggler in slot i out of the table */
+static void drop_stray(size_t i)
+{
+    member_t *l = leader(table[i].job);
+
+    if (l != NULL)
+    {
+        l->members--;
+        if (table[i].child)
+            l->strays--;
+    }
+    if (!table[i].child)
+        loose--;
+    unlink_slot(i);
+}
+
+/* survey - Bring the stragglers in the table up to date with /proc,
+ * putting unclaimed children of the shell down to l's job (if l is not
+ * NULL) */
+static void survey(member_t *l)
+{
+    member_t *m;
+    pid_t job;
+    size_t j;
+    int i;
+    long long start = now_ms(), took;
+
+    surveys++;
+    scan();
+    memset(byid, 0, sizeof(byid));
+    for (i = 0; i < nprocs; i++)
+    {
+        for (j = home(procs[i].pid, PROC_SLOTS); byid[j] != 0; j = (j + 1) & (PROC_SLOTS - 1))
+            ;
+        byid[j] = i + 1;
+    }
+
+    /* Orphans first, so that owner_of finds them for what they started */
+    for (i = 0; l != NULL && i < nprocs; i++)
+    {
+        if (procs[i].ppid == shell && claim(procs[i].pid, procs[i].pgid) == 0)
+            enter(procs[i].pid, 1, l->pid);
+    }
+    for (i = 0; i < nprocs; i++)
+    {
+        m = &table[find(procs[i].pid)];
+        if (m->pid == procs[i].pid)
+        {
+            if (m->job == m->pid)
+                continue;
+            /* A straggler whose parent has died is now ours */
+            m->seen = surveys;
+            if (procs[i].ppid == shell)
+                promote(m);
+            continue;
+        }
+        if ((job = owner_of(i)) > 0 && procs[i].pgid != job)
+            enter(procs[i].pid, procs[i].ppid == shell, job);
+    }
+
+    /* Stragglers that are not ours are never reaped by us: drop those
+     * that this survey did not see (unless it could not see them all) */
+    for (j = 0; loose > 0 && !truncated && j < REAPER_SLOTS;)
+    {
+        /* Unlinking may shift another entry into slot j */
+        if (table[j].pid != 0 && table[j].job != table[j].pid && !table[j].child &&
+            table[j].seen != surveys)
+            drop_stray(j);
+        else
+            j++;
+    }
+
+    took = now_ms() - start;
+    nextscan = start + took + (took * SCAN_SHARE > SCAN_GAP_MS ? took * SCAN_SHARE : SCAN_GAP_MS);
+}
+
+/* adopt - Put the children of the shell that nobody claims down to l's
+ * job.  Costs what the shell has children, not what the system has
+ * processes; without the children list it is a survey. */
+static void adopt(member_t *l)
+{
+    static char buf[DENTS_BUFSIZE];
+    member_t *m;
+    ssize_t n, len = 0;
+    pid_t pid, pgid;
+    char *s;
+    int fd;
+
+    lastadopt = now_ms();
+    if ((fd = open(kids, O_RDONLY | O_CLOEXEC)) < 0)
+    {
+        survey(l);
+        return;
+    }
+    while (len < DENTS_BUFSIZE - 1 && (n = read(fd, buf + len, DENTS_BUFSIZE - 1 - len)) > 0)
+        len += n;
+    close(fd);
+    buf[len] = '\0';
+
+    for (s = buf; *s != '\0';)
+    {
+        if ((pid = parse(&s)) == 0)
+        {
+            s++; /* the space after each PID */
+            continue;
+        }
+        m = &table[find(pid)];
+        if (m->pid == pid)
+        {
+            if (m->job != pid)
+                promote(m); /* its parent has died */
+            continue;
+        }
+        if ((pgid = getpgid(pid)) > 0 && leader(pgid) == NULL)
+            enter(pid, 1, l->pid);
+    }
+}
+
+/*
+ * reaper_init - Become the child subreaper of our jobs' descendants.
+ *    Without it, jobs end with their leaders as they always did.
+ */
+void reaper_init(void)
+{
+    shell = getpid();
+    snprintf(kids, sizeof(kids), "/proc/%d/task/%d/children", (int) shell, (int) shell);
+    if (prctl(PR_SET_CHILD_SUBREAPER, 1) < 0)
+    {
+        printf("prctl: %s (jobs end with their leaders)\n", strerror(errno));
+        return;
+    }
+    subreaping = 1;
+}
+
+/*
+ * reaper_add - Track a job that has just been added (by its leader)
+ */
+void reaper_add(pid_t job)
+{
+    member_t *l = insert(job);
+
+    if (l != NULL)
+        l->job = job;
+}
+
+/*
+ * reaper_drop - Stop tracking a job that is being deleted
+ */
+void reaper_drop(pid_t job)
+{
+    member_t *l = leader(job);
+    size_t i;
+
+    if (l == NULL)
+        return;
+    for (i = 0; l->members > 0 && i < REAPER_SLOTS;)
+    {
+        /* Unlinking may shift another entry into slot i */
+        if (table[i].pid != 0 && table[i].pid != job && table[i].job == job)
+            drop_stray(i);
+        else
+            i++;
+    }
+    unlink_slot(find(job));
+}
+
+/*
+ * reaper_release - A job's list is going away (its session closed)
+ *    though the job still runs.  It is forgotten once its leader is
+ *    reaped, by nobody.
+ */
+void reaper_release(pid_t job)
+{
+    member_t *l = leader(job);
+
+    if (l != NULL && l->status != LIVE)
+        reaper_drop(job);
+    else if (l != NULL)
+        l->released = 1;
+}
+
+/*
+ * reaper_wait - waitpid(-1, status, WNOHANG | WUNTRACED), noting whose
+ *    the child was for reaper_job
+ */
+pid_t reaper_wait(int *status)
+{
+    sigset_t mask_all, prev_all;
+    siginfo_t info;
+    member_t *m;
+    pid_t pid;
+
+    lastpgid = 0;
+    if (subreaping)
+    {
+        /* Peek first: until it is reaped, a child is still in its group */
+        info.si_pid = 0;
+        if (waitid(P_ALL, 0, &info, WEXITED | WSTOPPED | WNOHANG | WNOWAIT) < 0 ||
+            info.si_pid == 0)
+            return 0;
+        lastpgid = getpgid(info.si_pid);
+        pid = waitpid(info.si_pid, status, WNOHANG | WUNTRACED);
+    }
+    else
+        pid = waitpid(-1, status, WNOHANG | WUNTRACED);
+    if (pid <= 0)
+        return pid;
+
+    lastpid = pid;
+    lastjob = claim(pid, lastpgid);
+    m = &table[find(pid)];
+    if (WIFSTOPPED(*status))
+        return pid;
+
+    Sigfillset(&mask_all);
+    Sigprocmask(SIG_BLOCK, &mask_all, &prev_all); // reaper_kill reads the table
+    if (m->pid == pid && m->job != pid)
+        drop_stray(m - table);
+    else if (m->pid == pid && m->released)
+        reaper_drop(pid);
+
+    /* Only a child that is not a leader can have left stragglers that
+     * still have parents */
+    if (subreaping && lastjob != pid && now_ms() >= nextscan)
+        survey(NULL);
+    Sigprocmask(SIG_SETMASK, &prev_all, NULL);
+    return pid;
+}
+
+/*
+ * reaper_job - The job (its leader's PID) that the child just returned
+ *    by reaper_wait was part of, or 0 if it was nobody's
+ */
+pid_t reaper_job(pid_t pid)
+{
+    return (pid == lastpid) ? lastjob : claim(pid, getpgid(pid));
+}
+
+/*
+ * reaper_done - Process pid of job has exited with *status.  Returns
+ *    true if that was the last of the job's tree, with the status of
+ *    its leader in *status.  Called with signals blocked.
+ */
+int reaper_done(pid_t job, pid_t pid, int *status)
+{
+    member_t *l = leader(job);
+
+    if (l == NULL)
+        return pid == job; /* the table was full when it started */
+    if (pid == job)
+        l->status = *status;
+    if (l->status == LIVE)
+        return 0;
+    if (!subreaping)
+        return 1;
+
+    /* An orphan of a process of the group is in it itself (unless it
+     * broke away, and then it is found when the group empties) */
+    if (pid == job || (!group_alive(job) && l->strays == 0) ||
+        ((pid != lastpid || lastpgid != job) && now_ms() - lastadopt >= SCAN_GAP_MS))
+        adopt(l);
+    if (group_alive(job) || l->strays > 0)
+        return 0;
+    *status = l->status;
+    return 1;
+}
+
+/*
+ * reaper_orphaned - Whether job's leader is gone but not the rest of it
+ */
+int reaper_orphaned(pid_t job)
+{
+    member_t *l = leader(job);
+
+    return l != NULL && l->status != LIVE;
+}
+
+/*
+ * reaper_kill - Send sig to a job's whole tree
+ */
+void reaper_kill(pid_t job, int sig)
+{
+    sigset_t mask_all, prev_all;
+    member_t *l;
+    size_t i;
+
+    Sigfillset(&mask_all);
+    Sigprocmask(SIG_BLOCK, &mask_all, &prev_all); // the table
+
+    /* Stragglers found from now on get it too (enter).  A continue
+     * cancels a stop, but not a signal that ends the job. */
+    if ((l = leader(job)) != NULL)
+    {
+        if (sig != SIGCONT)
+            l->sig = sig;
+        else if (l->sig == SIGTSTP || l->sig == SIGSTOP)
+            l->sig = 0;
+    }
+
+    if (kill(-job, sig) < 0)
+        kill(job, sig); /* a child that has not reached setpgid has no group */
+    for (i = 0; (l = leader(job)) != NULL && l->members > 0 && i < REAPER_SLOTS; i++)
+    {
+        if (table[i].pid != 0 && table[i].pid != job && table[i].job == job)
+            kill(table[i].pid, sig);
+    }
+    Sigprocmask(SIG_SETMASK, &prev_all, NULL);
+}
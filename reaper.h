@@ -0,0 +1,18 @@
+/* Whole process trees as jobs.  The shell is the child subreaper of
+ * everything its jobs start, so a job's orphaned descendants become the
+ * shell's children instead of init's.  A job is done only once its whole
+ * tree has exited, and signals sent to a job reach all of it, stragglers
+ * outside its process group included. */
+
+#define REAPER_SLOTS (1 << 16) /* leaders and stragglers tracked at once */
+#define REAPER_PROCS 32768     /* processes looked at in one scan of /proc */
+
+void reaper_init(void);
+void reaper_add(pid_t job);
+void reaper_drop(pid_t job);
+void reaper_release(pid_t job);
+pid_t reaper_wait(int *status);
+pid_t reaper_job(pid_t pid);
+int reaper_done(pid_t job, pid_t pid, int *status);
+int reaper_orphaned(pid_t job);
+void reaper_kill(pid_t job, int sig);
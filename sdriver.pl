@@ -3,6 +3,7 @@
 use Getopt::Std;
 use FileHandle;
 use IPC::Open2;
+use Time::HiRes qw(sleep);
 
 #######################################################################
 # sdriver.pl - Shell driver
@@ -32,7 +33,13 @@ use IPC::Open2;
 #     KILL        Send a SIGKILL signal to the child
 #     CLOSE       Close Writer (sends EOF signal to child)
 #     WAIT        Wait() for child to terminate
-#     SLEEP <n>   Sleep for <n> seconds
+#     SLEEP <n>   Sleep for <n> seconds (fractions allowed, and <n>ms
+#                 means milliseconds)
+#
+# With -T <scale> every SLEEP is scaled by <scale>, and so are the
+# seconds that myspin, mysplit, mystop and myint count, through the
+# TSH_TIMESCALE environment variable (see timescale.h).  A small scale
+# runs a trace in a fraction of the time with the same output.
 # 
 ######################################################################
 
@@ -42,19 +49,20 @@ use IPC::Open2;
 sub usage 
 {
     printf STDERR "$_[0]\n";
-    printf STDERR "Usage: $0 [-hv] -t <trace> -s <shellprog> -a <args>\n";
+    printf STDERR "Usage: $0 [-hv] -t <trace> -s <shellprog> -a <args> [-T <scale>]\n";
     printf STDERR "Options:\n";
     printf STDERR "  -h            Print this message\n";
     printf STDERR "  -v            Be more verbose\n";
     printf STDERR "  -t <trace>    Trace file\n";
     printf STDERR "  -s <shell>    Shell program to test\n";
     printf STDERR "  -a <args>     Shell arguments\n";
+    printf STDERR "  -T <scale>    Scale all delays by <scale> (default 1)\n";
     printf STDERR "  -g            Generate output for autograder\n";
     die "\n" ;
 }
 
 # Parse the command line arguments
-getopts('hgvt:s:a:');
+getopts('hgvt:s:a:T:');
 if ($opt_h) {
     usage();
 }
@@ -69,6 +77,10 @@ $infile = $opt_t;
 $shellprog = $opt_s;
 $shellargs = $opt_a;
 $grade = $opt_g;
+$scale = $opt_T ? $opt_T : 1;
+$scale > 0
+    or usage("The -T scale must be positive");
+$ENV{TSH_TIMESCALE} = $scale;
 
 # Make sure the input script exists and is readable
 -e $infile
@@ -172,11 +184,12 @@ while (<INFILE>) {
     }
 
     # Sleep
-    elsif ($line =~ /SLEEP (\d+)/) {
+    elsif ($line =~ /SLEEP (\d+\.?\d*|\.\d+)(ms)?/) {
+	$secs = ($2 ? $1 / 1000 : $1) * $scale;
 	if ($verbose) {
-	    print "$0: Sleeping $1 secs\n";
+	    print "$0: Sleeping $secs secs\n";
 	}
-	sleep $1;
+	sleep $secs;
     }
 
     # Unknown input
@@ -0,0 +1,89 @@
+#!/usr/bin/perl
+use Getopt::Std;
+use Time::HiRes qw(time);
+
+#######################################################################
+# senvbench.pl - Benchmark launching commands with a large environment
+#
+# Starts the shell with <e> extra environment variables and times <n>
+# foreground launches of /bin/true in each of these ways:
+#
+#     launch   /bin/true
+#     prefix   V=<i> /bin/true
+#     env(1)   /usr/bin/env V=<i> /bin/true  (what prefix replaces)
+#     export   export V=<i> then /bin/true   (a value changes)
+#     grow     export V<i>=1 then /bin/true  (a variable is added)
+#
+# and checks that the last command of each run saw the right value.
+######################################################################
+
+#
+# usage - print help message
+#
+sub usage
+{
+    printf STDERR "$_[0]\n";
+    printf STDERR "Usage: $0 [-h] [-s <shellprog>] [-n <launches>] [-e <vars>]\n";
+    printf STDERR "Options:\n";
+    printf STDERR "  -h            Print this message\n";
+    printf STDERR "  -s <shell>    Shell program to test (default ./tsh)\n";
+    printf STDERR "  -n <launches> Commands to launch per run (default 1000)\n";
+    printf STDERR "  -e <vars>     Variables in the environment (default 10000)\n";
+    die "\n" ;
+}
+
+getopts('hs:n:e:');
+if ($opt_h) {
+    usage();
+}
+$shellprog = $opt_s ? $opt_s : "./tsh";
+$nlaunch = $opt_n ? $opt_n : 1000;
+$nvars = defined($opt_e) ? $opt_e : 10000;
+$script = "/tmp/tshenv$$.txt";
+
+-x $shellprog
+    or die "$0: ERROR: $shellprog not found or not executable\n";
+
+for ($i = 0; $i < $nvars; $i++) {
+    $ENV{sprintf("BENCH_%05d", $i)} = "x" x 32;
+}
+
+#
+# run - Run one benchmark: the shell reads the lines from $gen->($i),
+#     then prints V through printenv, which must print $want (nothing
+#     if V is not set)
+#
+sub run
+{
+    my ($name, $launches, $gen, $want) = @_;
+    my ($start, $secs, $out);
+
+    $want .= "\n" if ($want ne "");
+
+    open(SCRIPT, ">$script")
+	or die "$0: ERROR: Couldn't write $script: $!\n";
+    for ($i = 0; $i < $nlaunch; $i++) {
+	print SCRIPT $gen->($i);
+    }
+    print SCRIPT "/usr/bin/printenv V\n";
+    close(SCRIPT);
+
+    $start = time();
+    $out = `$shellprog -p < $script`;
+    $secs = time() - $start;
+
+    printf "%-8s %6d launches in %6.3f secs (%6.0f launches/sec)%s\n",
+	$name, $launches, $secs, $launches / $secs,
+	($out eq $want) ? "" : " WRONG: got \"$out\"";
+    $errors++ if ($out ne $want);
+}
+
+$last = $nlaunch - 1;
+printf "%d variables in the environment\n", scalar(keys %ENV);
+run("launch", $nlaunch, sub { "/bin/true\n" }, "");
+run("prefix", $nlaunch, sub { "V=$_[0] /bin/true\n" }, "");
+run("env(1)", $nlaunch, sub { "/usr/bin/env V=$_[0] /bin/true\n" }, "");
+run("export", $nlaunch, sub { "export V=$_[0]\n/bin/true\n" }, "$last");
+run("grow", $nlaunch, sub { "export V$_[0]=1\n/bin/true\n" }, "");
+unlink($script);
+exit($errors ? 1 : 0);
@@ -0,0 +1,556 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio_ext.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include "jobs.h"
+#include "wrappers.h"
+#include "server.h"
+#include "deadline.h"
+#include "after.h"
+#include "snapshot.h"
+#include "env.h"
+#include "perfstat.h"
+#include "reaper.h"
+#include "capture.h"
+
+/* Server mode.  A single process accepts clients on a Unix domain socket
+ * and multiplexes their sessions with epoll.  Rather than threading a
+ * session through eval and the job routines, the server switches the
+ * current session before running any shell code: jobs, nextjid and env
+ * are pointed at the session's own copies, and stdout/stderr are dup2'd to
+ * its socket so children write to the right client.
+ *
+ * The server itself never blocks writing to a client.  Its stdout is a
+ * stream whose writes go to the current session's output queue, which is
+ * sent as the socket takes it (EPOLLOUT).  A client that lets the queue
+ * grow past OUTQ_MAX is disconnected.  (Children write to the socket
+ * directly, so their output can overtake what is still queued.)
+ *
+ * A foreground job can't block the server, so waitfg returns at once
+ * and the session is parked (its input is not read) until the job is
+ * reaped or stopped.  All sessions share one SIGCHLD stream: the handler
+ * only writes to a self-pipe, and the event loop reaps and hands each
+ * child to the session that owns it. */
+
+#define MAXEVENTS 64        /* events per epoll_wait */
+#define OUTQ_MAX  (1 << 20) /* bytes queued for a client before hanging up */
+
+typedef struct session
+{
+    int fd;                 /* client socket */
+    int eof;                /* client has closed its end */
+    int closing;            /* quit or EOF seen; free when idle */
+    int nextjid;            /* this session's nextjid */
+    int polling;            /* socket is watched for input */
+    int events;             /* what it is registered for in epoll */
+    int gone;               /* output can't be sent; discard it */
+    int lingering;          /* closed, but output is still queued */
+    int dead;               /* closed for good: on the dead list */
+    char *out;              /* output queue */
+    size_t outlen, outcap;  /* bytes in it, and room for */
+    size_t inlen;           /* bytes in inbuf */
+    char inbuf[MAXLINE];    /* partial input lines */
+    job_t jobs[MAXJOBS];    /* this session's job list */
+    env_t *env;             /* this session's variables */
+    struct session *prev, *next;
+} session_t;
+
+extern char prompt[];
+void eval(char *cmdline);
+void update_job(pid_t pid, int status);
+
+int serving = 0;
+
+static int epfd;                  /* epoll instance */
+static int listenfd;              /* listening socket */
+static int sigpipe[2];            /* SIGCHLD self-pipe */
+static int devnull;               /* stdout when no session is current */
+static int prompting;             /* emit prompts (no -p) */
+static session_t *sessions;       /* all live sessions */
+static session_t *current;        /* session whose jobs/stdout are live */
+static session_t *dead;           /* sessions to free after this batch */
+static job_t nojobs[MAXJOBS];     /* job list when no session is current */
+static env_t *noenv;              /* the shell's environment, which
+                                     sessions start out sharing */
+static pid_t server_pid;          /* the server, as opposed to its children */
+
+/*
+ * update_events - Register a session's socket for input while it is
+ *     polling and for output while it has some queued.  A socket with
+ *     neither is removed outright, since epoll would go on reporting a
+ *     hangup on it even with no events requested.
+ */
+static void update_events(session_t *s)
+{
+    struct epoll_event ev;
+    int op;
+
+    ev.events = (s->polling ? EPOLLIN : 0) | (s->outlen > 0 ? EPOLLOUT : 0);
+    ev.data.ptr = s;
+    if ((int) ev.events == s->events)
+        return;
+    op = (s->events == 0) ? EPOLL_CTL_ADD : (ev.events == 0) ? EPOLL_CTL_DEL : EPOLL_CTL_MOD;
+    if (epoll_ctl(epfd, op, s->fd, &ev) < 0)
+        unix_error("epoll_ctl error");
+    s->events = ev.events;
+}
+
+/*
+ * flush_output - Send as much of a session's output queue as the socket
+ *     takes without blocking
+ */
+static void flush_output(session_t *s)
+{
+    ssize_t n;
+    size_t sent = 0;
+
+    while (sent < s->outlen)
+    {
+        n = send(s->fd, s->out + sent, s->outlen - sent, MSG_DONTWAIT | MSG_NOSIGNAL);
+        if (n > 0)
+            sent += n;
+        else if (n < 0 && errno == EINTR)
+            continue;
+        else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            break;
+        else
+        {
+            s->gone = 1; /* the client has gone; its input side says so */
+            sent = s->outlen;
+        }
+    }
+    s->outlen -= sent;
+    memmove(s->out, s->out + sent, s->outlen);
+    update_events(s);
+}
+
+/*
+ * queue_write - The server's stdout: queue output for the current session.
+ *     A forked child just writes to its stdout, which is the socket.
+ */
+static ssize_t queue_write(void *cookie, const char *buf, size_t size)
+{
+    session_t *s = current;
+    ssize_t n;
+    size_t done;
+
+    if (getpid() != server_pid)
+    {
+        for (done = 0; done < size; done += n)
+            if ((n = write(STDOUT_FILENO, buf + done, size - done)) <= 0)
+                return done > 0 ? (ssize_t) done : -1;
+        return size;
+    }
+    if (s == NULL || s->gone)
+        return size;
+    if (s->outlen + size > OUTQ_MAX)
+    {
+        /* Not reading: hang up once the line being run is done */
+        s->gone = s->closing = 1;
+        s->outlen = 0;
+        update_events(s);
+        return size;
+    }
+    if (s->outlen + size > s->outcap)
+    {
+        while (s->outlen + size > s->outcap)
+            s->outcap = s->outcap ? s->outcap * 2 : 4096;
+        if ((s->out = realloc(s->out, s->outcap)) == NULL)
+            unix_error("realloc error");
+    }
+    memcpy(s->out + s->outlen, buf, size);
+    s->outlen += size;
+    flush_output(s);
+    return size;
+}
+
+/*
+ * switch_session - Make s the current session (NULL for none)
+ */
+static void switch_session(session_t *s)
+{
+    int fd;
+
+    if (s == current)
+        return;
+
+    /* Anything still buffered belongs to the old session */
+    if (fflush(stdout) == EOF)
+    {
+        __fpurge(stdout);
+        clearerr(stdout);
+    }
+    if (current != NULL)
+    {
+        current->nextjid = nextjid;
+        current->env = env; /* it may have been copied on write */
+    }
+
+    fd = (s != NULL) ? s->fd : devnull;
+    dup2(fd, STDOUT_FILENO);
+    dup2(fd, STDERR_FILENO);
+    jobs = (s != NULL) ? s->jobs : nojobs;
+    env = (s != NULL) ? s->env : noenv;
+    if (s != NULL)
+        nextjid = s->nextjid;
+    current = s;
+}
+
+/*
+ * set_polling - Watch (or stop watching) a session's socket for input
+ */
+static void set_polling(session_t *s, int on)
+{
+    s->polling = on;
+    update_events(s);
+}
+
+/* free_session - Close a session's socket once its output has gone.  The
+ * memory is freed by the event loop, after the batch of events that may
+ * still point to it. */
+static void free_session(session_t *s)
+{
+    s->outlen = 0;
+    update_events(s);
+    close(s->fd);
+    free(s->out);
+    s->dead = 1;
+    s->next = dead;
+    dead = s;
+}
+
+/*
+ * close_session - Hang up on a client.  Its jobs get SIGHUP, as they
+ *     would from a terminal, and are reaped anonymously later.
+ */
+static void close_session(session_t *s)
+{
+    int i;
+
+    for (i = 0; i < MAXJOBS; i++)
+    {
+        if (s->jobs[i].pid != 0)
+        {
+            reaper_kill(s->jobs[i].pid, SIGHUP);
+            reaper_kill(s->jobs[i].pid, SIGCONT);
+            if (s->jobs[i].deadline != NULL)
+                deadline_cancel(&s->jobs[i]);
+            snapshot_drop(&s->jobs[i]);
+            if (s->jobs[i].perf >= 0)
+                perf_close(&s->jobs[i]);
+            reaper_release(s->jobs[i].pid);
+        }
+    }
+
+    after_forget(s->jobs);
+    perf_forget(s->jobs);
+    capture_forget(s->jobs);
+    switch_session(NULL);
+    env_release(s->env);
+
+    if (s->prev != NULL)
+        s->prev->next = s->next;
+    else
+        sessions = s->next;
+    if (s->next != NULL)
+        s->next->prev = s->prev;
+
+    /* Output still queued is sent first, outside the session list */
+    s->lingering = 1;
+    set_polling(s, 0);
+    if (s->outlen == 0)
+        free_session(s);
+}
+
+/*
+ * run_session - Evaluate the complete lines buffered for a session until
+ *     it runs out of input, starts a foreground job, or quits
+ */
+static void run_session(session_t *s)
+{
+    char cmdline[MAXLINE];
+    char *nl;
+    size_t len;
+
+    switch_session(s);
+    while (!s->closing && fgpid(jobs) == 0)
+    {
+        if ((nl = memchr(s->inbuf, '\n', s->inlen)) != NULL)
+            len = nl - s->inbuf + 1;
+        else if (s->inlen == MAXLINE - 1)
+            len = s->inlen; /* overlong line, split like fgets */
+        else
+            break;
+
+        memcpy(cmdline, s->inbuf, len);
+        cmdline[len] = '\0';
+        s->inlen -= len;
+        memmove(s->inbuf, s->inbuf + len, s->inlen);
+
+        fflush(stdout); /* a forked child must not inherit buffered output */
+        eval(cmdline);
+        if (prompting && !s->closing && fgpid(jobs) == 0)
+            printf("%s", prompt);
+    }
+    fflush(stdout);
+
+    /* Like tsh at EOF, drop any unterminated last line */
+    if (s->eof && fgpid(jobs) == 0)
+        s->closing = 1;
+    if (s->closing)
+        close_session(s);
+    else
+        set_polling(s, fgpid(jobs) == 0);
+}
+
+/*
+ * accept_clients - Start a session for every pending connection
+ */
+static void accept_clients(void)
+{
+    struct epoll_event ev;
+    session_t *s;
+    int fd;
+
+    while ((fd = accept4(listenfd, NULL, NULL, SOCK_CLOEXEC)) >= 0)
+    {
+        if ((s = malloc(sizeof(session_t))) == NULL)
+        {
+            close(fd);
+            continue;
+        }
+        s->fd = fd;
+        s->eof = s->closing = s->gone = s->lingering = s->dead = 0;
+        s->inlen = 0;
+        s->polling = 1;
+        s->events = EPOLLIN;
+        s->out = NULL;
+        s->outlen = s->outcap = 0;
+        s->env = env_share(noenv);
+        s->prev = NULL;
+        s->next = sessions;
+        if (sessions != NULL)
+            sessions->prev = s;
+        sessions = s;
+
+        /* initjobs resets the global nextjid, so it runs in the session */
+        switch_session(s);
+        initjobs(jobs);
+
+        ev.events = EPOLLIN;
+        ev.data.ptr = s;
+        if (epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) < 0)
+            unix_error("epoll_ctl error");
+        if (prompting)
+        {
+            printf("%s", prompt);
+            fflush(stdout);
+        }
+    }
+    if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+        unix_error("accept error");
+}
+
+/*
+ * client_input - Read what a client sent and run any complete lines
+ */
+static void client_input(session_t *s)
+{
+    ssize_t n;
+
+    n = read(s->fd, s->inbuf + s->inlen, MAXLINE - 1 - s->inlen);
+    if (n > 0)
+        s->inlen += n;
+    else if (n == 0 || errno != EINTR)
+        s->eof = 1;
+    run_session(s);
+}
+
+/*
+ * reap_children - Reap every waiting child and pass it to its session.
+ *     Children of sessions that have already closed are just reaped.
+ */
+static void reap_children(void)
+{
+    char drain[64];
+    int status;
+    pid_t pid, job;
+    session_t *s;
+
+    while (read(sigpipe[0], drain, sizeof(drain)) > 0)
+        ;
+
+    while ((pid = reaper_wait(&status)) > 0)
+    {
+        /* Stragglers of a job are passed on as the job's (see reaper.c) */
+        job = reaper_job(pid);
+        for (s = sessions; s != NULL; s = s->next)
+            if (getjobpid(s->jobs, job) != NULL)
+                break;
+        if (s == NULL)
+            continue;
+
+        switch_session(s);
+        update_job(pid, status);
+        if (fgpid(jobs) == 0 && (!s->polling || s->closing))
+        {
+            /* The foreground job is done; pick up where it left off (or
+             * hang up, if the client stopped reading) */
+            if (prompting && !s->closing)
+                printf("%s", prompt);
+            run_session(s);
+        }
+    }
+    fflush(stdout);
+}
+
+/* server_sigchld - Defer SIGCHLD to the event loop */
+static void server_sigchld(int sig)
+{
+    int olderrno = errno;
+
+    write(sigpipe[1], "", 1);
+    errno = olderrno;
+}
+
+/* server_sigpipe - A client went away mid-write.  This is a handler
+ * rather than SIG_IGN so that children get the default back at exec. */
+static void server_sigpipe(int sig)
+{
+}
+
+/*
+ * serve - Accept clients on the socket at path and run their sessions.
+ *     Never returns.
+ */
+void serve(char *path, int emit_prompt)
+{
+    struct epoll_event ev, events[MAXEVENTS];
+    struct sockaddr_un addr;
+    struct rlimit rl;
+    session_t *s;
+    int i, n;
+
+    cookie_io_functions_t queue = {NULL, queue_write, NULL, NULL};
+
+    serving = 1;
+    prompting = emit_prompt;
+    server_pid = getpid();
+
+    /* Each session costs a descriptor, so allow as many as we may */
+    if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur < rl.rlim_max)
+    {
+        rl.rlim_cur = rl.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &rl);
+    }
+
+    /* There is no terminal to take ctrl-c or ctrl-z from */
+    Signal(SIGINT, SIG_DFL);
+    Signal(SIGTSTP, SIG_DFL);
+    Signal(SIGPIPE, server_sigpipe);
+
+    if ((devnull = open("/dev/null", O_RDWR | O_CLOEXEC)) < 0)
+        unix_error("open error");
+    dup2(devnull, STDIN_FILENO);
+    fflush(stdout);
+    if ((stdout = fopencookie(NULL, "w", queue)) == NULL)
+        unix_error("fopencookie error");
+    initjobs(nojobs);
+    jobs = nojobs;
+    noenv = env;
+
+    if (pipe2(sigpipe, O_NONBLOCK | O_CLOEXEC) < 0)
+        unix_error("pipe error");
+    Signal(SIGCHLD, server_sigchld);
+
+    if (strlen(path) >= sizeof(addr.sun_path))
+        app_error("socket path too long");
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+    unlink(path);
+    if ((listenfd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0)) < 0)
+        unix_error("socket error");
+    if (bind(listenfd, (struct sockaddr *) &addr, sizeof(addr)) < 0)
+        unix_error("bind error");
+    if (listen(listenfd, SOMAXCONN) < 0)
+        unix_error("listen error");
+
+    if ((epfd = epoll_create1(EPOLL_CLOEXEC)) < 0)
+        unix_error("epoll_create error");
+    ev.events = EPOLLIN;
+    ev.data.ptr = &listenfd;
+    if (epoll_ctl(epfd, EPOLL_CTL_ADD, listenfd, &ev) < 0)
+        unix_error("epoll_ctl error");
+    ev.data.ptr = sigpipe;
+    if (epoll_ctl(epfd, EPOLL_CTL_ADD, sigpipe[0], &ev) < 0)
+        unix_error("epoll_ctl error");
+
+    while (1)
+    {
+        if ((n = epoll_wait(epfd, events, MAXEVENTS, -1)) < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            unix_error("epoll_wait error");
+        }
+
+        /* Reap first, so that input events below see up-to-date jobs.
+         * A session closed by then is only marked dead until the batch
+         * is done, since later events can still point to it. */
+        for (i = 0; i < n; i++)
+            if (events[i].data.ptr == sigpipe)
+                reap_children();
+
+        for (i = 0; i < n; i++)
+        {
+            if (events[i].data.ptr == sigpipe)
+                continue;
+            if (events[i].data.ptr == &listenfd)
+            {
+                accept_clients();
+                continue;
+            }
+            s = events[i].data.ptr;
+            if (s->dead)
+                continue;
+            if (s->outlen > 0 && (events[i].events & (EPOLLOUT | EPOLLERR | EPOLLHUP)))
+                flush_output(s);
+            if (s->lingering)
+            {
+                if (s->outlen == 0)
+                    free_session(s);
+                continue;
+            }
+            if (s->polling && (events[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP)))
+                client_input(s);
+        }
+
+        while (dead != NULL)
+        {
+            s = dead;
+            dead = s->next;
+            free(s);
+        }
+    }
+}
+
+/*
+ * end_session - The quit builtin in server mode: close the current
+ *     session once the line that ran it is done
+ */
+void end_session(void)
+{
+    if (current != NULL)
+        current->closing = 1;
+}
@@ -0,0 +1,7 @@
+/* tsh -S: one process serving many clients over a Unix domain socket.
+ * Each client gets a session with its own job list and output stream. */
+
+extern int serving; /* true in server mode */
+
+void serve(char *path, int emit_prompt);
+void end_session(void);
@@ -0,0 +1,88 @@
+#!/usr/bin/perl
+use Getopt::Std;
+use Time::HiRes qw(time);
+
+#######################################################################
+# slistbench.pl - Benchmark command lists (;, && and ||)
+#
+# Times <n> steps run each of these ways:
+#
+#     lines    /bin/true on <n> lines            (what a list replaces)
+#     list     /bin/true; /bin/true; ...         on one line
+#     and      /bin/true && /bin/true && ...
+#     or       /bin/false || /bin/false || ...
+#     builtin  true && true && ...               (no fork at all)
+#     skip     false && /bin/true && ...         (all but one skipped)
+#
+# Each run ends by echoing a marker, which must be the only output, and
+# reports the cost of a step in microseconds.
+######################################################################
+
+#
+# usage - print help message
+#
+sub usage
+{
+    printf STDERR "$_[0]\n";
+    printf STDERR "Usage: $0 [-h] [-s <shellprog>] [-n <steps>]\n";
+    printf STDERR "Options:\n";
+    printf STDERR "  -h            Print this message\n";
+    printf STDERR "  -s <shell>    Shell program to test (default ./tsh)\n";
+    printf STDERR "  -n <steps>    Commands per run (default 1000)\n";
+    die "\n" ;
+}
+
+getopts('hs:n:');
+if ($opt_h) {
+    usage();
+}
+$shellprog = $opt_s ? $opt_s : "./tsh";
+$nsteps = $opt_n ? $opt_n : 1000;
+$script = "/tmp/tshlist$$.txt";
+
+-x $shellprog
+    or die "$0: ERROR: $shellprog not found or not executable\n";
+
+#
+# run - Run one benchmark: the shell reads $text, then echoes a marker,
+#     which is all it may print
+#
+sub run
+{
+    my ($name, $text) = @_;
+    my ($start, $secs, $out);
+
+    open(SCRIPT, ">$script")
+	or die "$0: ERROR: Couldn't write $script: $!\n";
+    print SCRIPT $text;
+    print SCRIPT "/bin/echo done\n";
+    close(SCRIPT);
+
+    $start = time();
+    $out = `$shellprog -p < $script`;
+    $secs = time() - $start;
+
+    printf "%-8s %6d steps in %6.3f secs (%7.1f us/step)%s\n",
+	$name, $nsteps, $secs, $secs * 1e6 / $nsteps,
+	($out eq "done\n") ? "" : " WRONG: got \"$out\"";
+    $errors++ if ($out ne "done\n");
+}
+
+#
+# list - $nsteps copies of $cmd joined by $op
+#
+sub list
+{
+    my ($cmd, $op) = @_;
+
+    return join(" $op ", ($cmd) x $nsteps);
+}
+
+run("lines", "/bin/true\n" x $nsteps);
+run("list", list("/bin/true", ";") . "\n");
+run("and", list("/bin/true", "&&") . "\n");
+run("or", list("/bin/false", "||") . "\n");
+run("builtin", list("true", "&&") . "\n");
+run("skip", "false && " . list("/bin/true", "&&") . "\n");
+unlink($script);
+exit($errors ? 1 : 0);
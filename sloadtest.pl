@@ -0,0 +1,127 @@
+#!/usr/bin/perl
+use Getopt::Std;
+use IO::Socket::UNIX;
+use IO::Select;
+use POSIX ":sys_wait_h";
+use Time::HiRes qw(time sleep);
+
+#######################################################################
+# sloadtest.pl - Load test for tsh server mode (tsh -S)
+#
+# Starts the shell as a server, connects <n> clients at once, and has
+# every client run the same short script:
+#
+#     ./myspin 1 &
+#     jobs
+#     echo client <i>
+#     quit
+#
+# Each client must see exactly its own job [1] and its own echo line,
+# which checks that the sessions' job lists and output streams are
+# isolated from one another.
+######################################################################
+
+#
+# usage - print help message
+#
+sub usage
+{
+    printf STDERR "$_[0]\n";
+    printf STDERR "Usage: $0 [-hv] [-s <shellprog>] [-n <clients>]\n";
+    printf STDERR "Options:\n";
+    printf STDERR "  -h            Print this message\n";
+    printf STDERR "  -v            Be more verbose\n";
+    printf STDERR "  -s <shell>    Shell program to test (default ./tsh)\n";
+    printf STDERR "  -n <clients>  Number of concurrent clients (default 1000)\n";
+    die "\n" ;
+}
+
+getopts('hvs:n:');
+if ($opt_h) {
+    usage();
+}
+$verbose = $opt_v;
+$shellprog = $opt_s ? $opt_s : "./tsh";
+$nclients = $opt_n ? $opt_n : 1000;
+$sockpath = "/tmp/tshload$$.sock";
+
+-x $shellprog
+    or die "$0: ERROR: $shellprog not found or not executable\n";
+
+# Start the server
+$pid = fork();
+defined($pid)
+    or die "$0: ERROR: fork failed: $!\n";
+if ($pid == 0) {
+    exec($shellprog, "-p", "-S", $sockpath);
+    die "$0: ERROR: Couldn't run $shellprog: $!\n";
+}
+for ($i = 0; $i < 100 && ! -S $sockpath; $i++) {
+    sleep(0.05);
+}
+-S $sockpath
+    or die "$0: ERROR: $shellprog never created $sockpath\n";
+
+# Connect every client before any of them sends a command
+$start = time();
+$select = IO::Select->new();
+for ($i = 0; $i < $nclients; $i++) {
+    $client[$i] = IO::Socket::UNIX->new(Type => SOCK_STREAM, Peer => $sockpath)
+	or die "$0: ERROR: client $i couldn't connect: $!\n";
+    $index{fileno($client[$i])} = $i;
+    $output[$i] = "";
+    $select->add($client[$i]);
+}
+$connected = time();
+if ($verbose) {
+    printf "$0: %d clients connected in %.3f secs\n", $nclients, $connected - $start;
+}
+
+for ($i = 0; $i < $nclients; $i++) {
+    syswrite($client[$i], "./myspin 1 &\njobs\necho client $i\nquit\n");
+}
+
+# Collect output until every session has been closed by the server
+$open = $nclients;
+while ($open > 0) {
+    foreach $fh ($select->can_read(10)) {
+	$i = $index{fileno($fh)};
+	if (sysread($fh, $buf, 4096) > 0) {
+	    $output[$i] .= $buf;
+	}
+	else {
+	    $select->remove($fh);
+	    close($fh);
+	    $open--;
+	}
+    }
+    if (time() - $start > 60) {
+	last;
+    }
+}
+$finished = time();
+
+kill 'QUIT', $pid;
+waitpid($pid, 0);
+unlink($sockpath);
+
+# Check every client's transcript
+$errors = 0;
+for ($i = 0; $i < $nclients; $i++) {
+    if ($output[$i] !~ /^\[1\] \((\d+)\) \.\/myspin 1 &\n\[1\] \(\1\) Running \.\/myspin 1 &\nclient $i\n$/) {
+	if ($errors < 5) {
+	    print "$0: ERROR: client $i got:\n$output[$i]";
+	}
+	$errors++;
+    }
+}
+
+printf "%d clients, %d commands in %.3f secs (%.0f commands/sec)\n",
+    $nclients, 4 * $nclients, $finished - $connected,
+    4 * $nclients / ($finished - $connected);
+if ($errors) {
+    print "$0: ERROR: $errors of $nclients sessions were wrong\n";
+    exit 1;
+}
+print "All $nclients sessions passed\n";
+exit 0;
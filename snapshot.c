@@ -0,0 +1,149 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "jobs.h"
+#include "wrappers.h"
+#include "snapshot.h"
+
+/* With -m the shell keeps a copy of every job in a shared memory segment
+ * that tshtop maps read-only.  Readers never make a call into the shell
+ * and the shell never waits for a reader: each record is guarded by a
+ * seqlock, which the writer takes without blocking and a reader simply
+ * retries.
+ *
+ * Every update happens with signals blocked, so a signal handler can
+ * never start writing a record that the code it interrupted is halfway
+ * through (which would leave seq even in the middle of a write).
+ *
+ * The record a job occupies is in job->snap.  Free records are kept on a
+ * stack, so the ones in use stay packed below nrecs. */
+
+int publishing = 0;
+static struct snap_table *table;
+static char shmname[32];
+static pid_t owner;             /* the shell, not a forked child */
+static int freerecs[SNAP_JOBS]; /* stack of free records below nrecs */
+static int nfree;
+
+/* snapshot_close - Mark the table dead and remove it (at exit) */
+static void snapshot_close(void)
+{
+    if (getpid() != owner)
+        return; /* a forked child exiting */
+    __atomic_store_n(&table->magic, 0, __ATOMIC_RELEASE);
+    shm_unlink(shmname);
+}
+
+/*
+ * snapshot_open - Create the segment and start publishing (tsh -m)
+ */
+void snapshot_open(void)
+{
+    int fd;
+
+    owner = getpid();
+    snprintf(shmname, sizeof(shmname), "%s%d", SNAP_PREFIX, (int) owner);
+    /* Only the owner may read it: it holds every command line.  A
+     * leftover of an earlier shell with our PID is replaced, not reused,
+     * so that its mode cannot carry over. */
+    shm_unlink(shmname);
+    if ((fd = shm_open(shmname, O_RDWR | O_CREAT | O_EXCL, 0600)) < 0)
+        unix_error("shm_open error");
+    if (ftruncate(fd, sizeof(struct snap_table)) < 0)
+        unix_error("ftruncate error");
+    table = mmap(NULL, sizeof(struct snap_table), PROT_READ | PROT_WRITE,
+                 MAP_SHARED, fd, 0);
+    if (table == MAP_FAILED)
+        unix_error("mmap error");
+    close(fd);
+
+    table->shell = owner;
+    __atomic_store_n(&table->magic, SNAP_MAGIC, __ATOMIC_RELEASE);
+    atexit(snapshot_close);
+    publishing = 1;
+}
+
+/* write_begin - Take a record's seqlock: seq goes odd */
+static struct snap_job *write_begin(int rec)
+{
+    struct snap_job *r = &table->job[rec];
+
+    __atomic_store_n(&r->seq, r->seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE); /* seq is odd before any data */
+    return r;
+}
+
+/* write_end - Release a record's seqlock: seq goes even again */
+static void write_end(struct snap_job *r)
+{
+    __atomic_store_n(&r->seq, r->seq + 1, __ATOMIC_RELEASE);
+    __atomic_store_n(&table->changes, table->changes + 1, __ATOMIC_RELEASE);
+}
+
+/*
+ * snapshot_add - Publish a job addjob has just added.  If every record
+ *    is taken the job is not shown.
+ */
+void snapshot_add(job_t *job)
+{
+    struct snap_job *r;
+    struct timespec now;
+    int rec;
+
+    if (!publishing)
+        return;
+    if (nfree > 0)
+        rec = freerecs[--nfree];
+    else if (table->nrecs < SNAP_JOBS)
+        rec = table->nrecs;
+    else
+        return;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    r = write_begin(rec);
+    r->pid = job->pid;
+    r->jid = job->jid;
+    r->state = job->state;
+    r->start = now.tv_sec * 1000000000LL + now.tv_nsec;
+    strncpy(r->cmdline, job->cmdline, SNAP_CMDLEN - 1);
+    r->cmdline[strcspn(r->cmdline, "\n")] = '\0';
+    write_end(r);
+
+    if (rec == (int) table->nrecs)
+        __atomic_store_n(&table->nrecs, rec + 1, __ATOMIC_RELEASE);
+    job->snap = rec;
+}
+
+/*
+ * snapshot_update - Publish a job's new state
+ */
+void snapshot_update(job_t *job)
+{
+    struct snap_job *r;
+
+    if (job->snap < 0)
+        return;
+    r = write_begin(job->snap);
+    r->state = job->state;
+    write_end(r);
+}
+
+/*
+ * snapshot_drop - Free the record of a job that is being deleted
+ */
+void snapshot_drop(job_t *job)
+{
+    struct snap_job *r;
+
+    if (job->snap < 0)
+        return;
+    r = write_begin(job->snap);
+    r->pid = 0;
+    write_end(r);
+    freerecs[nfree++] = job->snap;
+    job->snap = -1;
+}
@@ -0,0 +1,35 @@
+/* tsh -m: publish the job table in shared memory for tshtop.
+ * The segment is SNAP_PREFIX followed by the shell's PID ("/tsh.1234").
+ * Each record has its own seqlock: seq is odd while the shell is writing
+ * the record, so a reader copies it and retries if seq was odd or changed. */
+
+#define SNAP_PREFIX "/tsh."
+#define SNAP_MAGIC  0x74736831 /* "tsh1" */
+#define SNAP_JOBS   4096       /* records (server mode has many job lists) */
+#define SNAP_CMDLEN 64         /* bytes of the command line kept */
+
+struct snap_job
+{
+    unsigned seq;             /* seqlock: odd while being written */
+    pid_t pid;                /* 0 if the record is free */
+    int jid;
+    int state;                /* FG, BG, ST or PD */
+    long long start;          /* CLOCK_MONOTONIC nanoseconds at addjob */
+    char cmdline[SNAP_CMDLEN];
+};
+
+struct snap_table
+{
+    unsigned magic;           /* SNAP_MAGIC; 0 once the shell has exited */
+    pid_t shell;              /* PID of the shell */
+    unsigned nrecs;           /* records ever used: readers stop here */
+    unsigned long changes;    /* bumped after every record update */
+    struct snap_job job[SNAP_JOBS];
+};
+
+extern int publishing; /* true with -m */
+
+void snapshot_open(void);
+void snapshot_add(job_t *job);
+void snapshot_update(job_t *job);
+void snapshot_drop(job_t *job);
@@ -0,0 +1,402 @@
+#!/usr/bin/perl
+use Getopt::Std;
+use IPC::Open2;
+use IO::Select;
+use POSIX ":sys_wait_h";
+use Time::HiRes qw(time sleep);
+
+#######################################################################
+# sstress.pl - Randomized stress test of tsh job control
+#
+# Each run starts a shell and drives it through a random series of
+# steps, with a random pause of up to 30 ms after each one:
+#
+#     cmd &        background jobs that exit, fork children (some left
+#                  behind when the job's first process exits) or stop
+#     cmd          the same in the foreground
+#     fg %n, bg %n, jobs
+#     INT, TSTP    signals sent to the shell (ctrl-c, ctrl-z)
+#     QUIT         (sometimes, as the last step)
+#
+# After every step the shell's jobs listing is checked against the
+# kernel's view of its children in /proc:
+#
+#     - jids and pids are unique, and no job is in the foreground
+#       while the shell reads commands
+#     - every job is a live child of the shell leading its own process
+#       group, stopped exactly when it is listed as Stopped, or has
+#       exited leaving children of the shell in its group
+#     - every child of the shell is a job or in a job's group, and none
+#       is left a zombie
+#
+# Since a job can change state just as it is listed, a check only
+# fails if it keeps failing for 100 ms.  A failing run is shrunk by
+# dropping steps while it still fails, and printed as a trace that
+# -t replays (commands, INT, TSTP, QUIT and SLEEP <secs> lines).
+######################################################################
+
+#
+# usage - print help message
+#
+sub usage
+{
+    printf STDERR "$_[0]\n";
+    printf STDERR "Usage: $0 [-hv] [-s <shellprog>] [-n <runs>] [-k <steps>] [-r <seed>]\n";
+    printf STDERR "       $0 [-hv] [-s <shellprog>] -t <trace>\n";
+    printf STDERR "Options:\n";
+    printf STDERR "  -h            Print this message\n";
+    printf STDERR "  -v            Print each run's steps\n";
+    printf STDERR "  -s <shell>    Shell program to test (default ./tsh)\n";
+    printf STDERR "  -n <runs>     Random runs (default 100)\n";
+    printf STDERR "  -k <steps>    Steps per run (default 20)\n";
+    printf STDERR "  -r <seed>     Seed of the first run (default from the clock)\n";
+    printf STDERR "  -t <trace>    Replay the steps in <trace> instead\n";
+    die "\n" ;
+}
+
+getopts('hvs:n:k:r:t:');
+if ($opt_h) {
+    usage();
+}
+$verbose = $opt_v;
+$shellprog = $opt_s ? $opt_s : "./tsh";
+$nruns = $opt_n ? $opt_n : 100;
+$nsteps = $opt_k ? $opt_k : 20;
+$seed = defined($opt_r) ? $opt_r : (time() ^ $$) & 0xffffff;
+$retries = 3;   # replays of a shrunk trace before deciding it passes
+
+-x $shellprog
+    or die "$0: ERROR: $shellprog not found or not executable\n";
+
+$SIG{PIPE} = 'IGNORE';  # a shell that died is reported, not fatal
+
+#
+# secs - A random duration from $lo to $hi seconds
+#
+sub secs
+{
+    my ($lo, $hi) = @_;
+
+    return sprintf("%.2f", $lo + rand($hi - $lo));
+}
+
+#
+# workload - A random command: one that just exits, one that forks
+#     children, or one that stops itself part way
+#
+sub workload
+{
+    my ($hi) = @_;
+    my $r = rand();
+
+    return "/bin/sleep " . secs(0.01, $hi) if ($r < 0.4);
+    return "/bin/sh -c 'exit 3'" if ($r < 0.5);
+    return "/bin/sh -c '/bin/sleep " . secs(0.01, $hi) . " & /bin/sleep " .
+	secs(0.01, $hi) . "; wait'" if ($r < 0.65);
+    return "/bin/sh -c '/bin/sleep " . secs(0.01, $hi) . " &'" if ($r < 0.75);
+    return "/bin/sh -c '/bin/sleep " . secs(0.01, $hi / 2) . "; kill -TSTP \$\$; /bin/sleep " .
+	secs(0.01, $hi / 2) . "'";
+}
+
+#
+# random_trace - The steps of one run: each is [line, pause in secs]
+#
+sub random_trace
+{
+    my @steps = ();
+    my ($i, $r, $line);
+
+    for ($i = 0; $i < $nsteps; $i++) {
+	$r = rand();
+	if ($r < 0.35) {
+	    $line = workload(0.4) . " &";
+	}
+	elsif ($r < 0.5) {
+	    $line = workload(0.15);
+	}
+	elsif ($r < 0.6) {
+	    $line = "INT";
+	}
+	elsif ($r < 0.7) {
+	    $line = "TSTP";
+	}
+	elsif ($r < 0.95) {
+	    $line = (rand() < 0.5 ? "fg" : "bg") . " %" . (1 + int(rand(4)));
+	}
+	else {
+	    $line = "jobs";
+	}
+	push(@steps, [$line, int(rand(31)) / 1000]);
+    }
+    push(@steps, ["QUIT", 0]) if (rand() < 0.1);
+    return @steps;
+}
+
+#
+# read_trace - The steps in a trace file
+#
+sub read_trace
+{
+    my ($file) = @_;
+    my @steps = ();
+
+    open(TRACE, $file)
+	or die "$0: ERROR: Couldn't open $file: $!\n";
+    while (<TRACE>) {
+	chomp;
+	next if (/^\s*$/ || /^#/);
+	if (/^SLEEP ([\d.]+)$/) {
+	    $steps[-1][1] += $1 if (@steps);
+	}
+	else {
+	    push(@steps, [$_, 0]);
+	}
+    }
+    close(TRACE);
+    return @steps;
+}
+
+#
+# print_trace - Print steps in the form read_trace reads
+#
+sub print_trace
+{
+    my $step;
+
+    foreach $step (@_) {
+	print "$step->[0]\n";
+	printf "SLEEP %.3f\n", $step->[1] if ($step->[1] > 0);
+    }
+}
+
+#
+# proc_stat - State, parent and process group of a process from
+#     /proc/<pid>/stat, or () if it is gone
+#
+sub proc_stat
+{
+    my ($pid) = @_;
+    my $stat;
+
+    open(STAT, "/proc/$pid/stat") or return ();
+    $stat = <STAT>;
+    close(STAT);
+    # The command name is in parentheses and may hold anything
+    $stat =~ /\) (\S) (\d+) (\d+) / or return ();
+    return ($1, $2, $3);
+}
+
+#
+# children - The shell's child processes, as pid => [state, group]
+#
+sub children
+{
+    my %kids = ();
+    my ($dir, $pid, $state, $ppid, $pgrp);
+
+    opendir(PROC, "/proc") or die "$0: ERROR: Couldn't read /proc: $!\n";
+    foreach $dir (readdir(PROC)) {
+	next unless ($dir =~ /^\d+$/);
+	($state, $ppid, $pgrp) = proc_stat($dir);
+	$kids{$dir} = [$state, $pgrp] if (defined($ppid) && $ppid == $shell);
+    }
+    closedir(PROC);
+    return %kids;
+}
+
+#
+# query - Have the shell list its jobs; returns the listing, or undef
+#     if the shell stopped answering
+#
+sub query
+{
+    my $mark = "@@" . ++$queries;
+    my ($buf, $end, $listing);
+
+    print SHELLIN "jobs\necho $mark\n" or return undef;
+    $end = time() + 5;
+    while ($output !~ /^\Q$mark\E\n/m) {
+	return undef if (time() > $end);
+	next unless ($select->can_read($end - time()));
+	return undef if (sysread(SHELLOUT, $buf, 4096) <= 0);
+	$output .= $buf;
+    }
+    ($listing, $output) = split(/^\Q$mark\E\n/m, $output, 2);
+    return $listing;
+}
+
+#
+# verify - Check a jobs listing against /proc; returns what is wrong,
+#     or "" if nothing is
+#
+sub verify
+{
+    my ($listing) = @_;
+    my (%jid, %pid, %kids, %groups, $state, $ppid, $pgrp);
+
+    %kids = children();
+    foreach $p (keys %kids) {
+	$groups{$kids{$p}[1]}++;
+    }
+    foreach (split(/\n/, $listing)) {
+	next unless (/^\[(\d+)\] \((\d+)\) (\w+) /);
+	my ($j, $p, $s) = ($1, $2, $3);
+	$seen{$p} = 1;
+	return "jid $j is listed twice" if ($jid{$j}++);
+	return "pid $p is listed twice" if ($pid{$p}++);
+	return "job [$j] ($p) is in the foreground while the shell reads commands"
+	    if ($s eq "Foreground");
+	($state, $ppid, $pgrp) = proc_stat($p);
+	# A job lasts as long as any of its tree (which the shell adopts)
+	next if (!defined($state) && $groups{$p});
+	return "job [$j] ($p) is listed, but the process is gone" unless (defined($state));
+	return "job [$j] ($p) is not a child of the shell" if ($ppid != $shell);
+	return "job [$j] ($p) is not leading its own process group" if ($pgrp != $p);
+	return "job [$j] ($p) was never reaped" if ($state eq "Z");
+	return "job [$j] ($p) is listed as $s, but is stopped"
+	    if ($state =~ /[Tt]/ && $s ne "Stopped");
+	return "job [$j] ($p) is listed as Stopped, but is not"
+	    if ($state !~ /[Tt]/ && $s eq "Stopped");
+    }
+    foreach $p (keys %kids) {
+	return "child $p was never reaped" if ($kids{$p}[0] eq "Z");
+	return "child $p is missing from the job list"
+	    unless ($pid{$p} || $pid{$kids{$p}[1]});
+    }
+    return "";
+}
+
+#
+# check - Check the shell's state, giving it 100 ms to settle
+#
+sub check
+{
+    my ($listing, $err, $i);
+
+    for ($i = 0; $i < 5; $i++) {
+	defined($listing = query())
+	    or return "the shell stopped answering";
+	$err = verify($listing);
+	return "" if ($err eq "");
+	sleep(0.02);
+    }
+    return $err;
+}
+
+#
+# finish - Stop the shell and everything it started
+#
+sub finish
+{
+    my ($p, $i);
+
+    kill 'QUIT', $shell;
+    for ($i = 0; $i < 100 && waitpid($shell, WNOHANG) == 0; $i++) {
+	sleep(0.02);
+    }
+    if ($i == 100) {
+	kill 'KILL', $shell;
+	waitpid($shell, 0);
+    }
+    foreach $p (keys %seen) {
+	kill 'KILL', -$p;
+    }
+    close(SHELLIN);
+    close(SHELLOUT);
+    return $i < 100;
+}
+
+#
+# run - Run a trace against a fresh shell; returns what went wrong, or
+#     "" if nothing did
+#
+sub run
+{
+    my $step;
+    my $err = "";
+
+    $shell = open2(\*SHELLOUT, \*SHELLIN, $shellprog, "-p");
+    SHELLIN->autoflush(1);
+    $select = IO::Select->new(\*SHELLOUT);
+    $output = "";
+    %seen = ();
+
+    # Signals sent before the shell sets its handlers would stop it
+    defined(query()) or $err = "the shell never answered";
+
+    foreach $step ($err eq "" ? @_ : ()) {
+	my ($line, $pause) = @$step;
+	print "    $line\n" if ($verbose);
+	$nsent++;
+	if ($line =~ /^(INT|TSTP|QUIT)$/) {
+	    kill $line, $shell;
+	}
+	else {
+	    print SHELLIN "$line\n";
+	}
+	sleep($pause);
+	if ($line eq "QUIT") {
+	    for ($i = 0; $i < 100 && waitpid($shell, WNOHANG) == 0; $i++) {
+		sleep(0.02);
+	    }
+	    $err = "the shell ignored SIGQUIT" if ($i == 100);
+	    last;
+	}
+	$nchecks++;
+	last if (($err = check()) ne "");
+    }
+    finish() or $err = $err || "the shell ignored SIGQUIT";
+    return $err;
+}
+
+#
+# shrink - Drop steps from a failing trace while it still fails
+#
+sub shrink
+{
+    my @steps = @_;
+    my ($i, $k, @try);
+
+    for ($i = $#steps; $i >= 0; $i--) {
+	@try = @steps;
+	splice(@try, $i, 1);
+	for ($k = 0; $k < $retries; $k++) {
+	    if (run(@try) ne "") {
+		@steps = @try;
+		last;
+	    }
+	}
+    }
+    return @steps;
+}
+
+$start = time();
+$errors = 0;
+if ($opt_t) {
+    @steps = read_trace($opt_t);
+    $err = run(@steps);
+    print(($err eq "") ? "$opt_t passed\n" : "$opt_t failed: $err\n");
+    exit($err eq "" ? 0 : 1);
+}
+
+for ($r = 0; $r < $nruns; $r++) {
+    srand($seed + $r);
+    @steps = random_trace();
+    print "run $r (seed ", $seed + $r, "):\n" if ($verbose);
+    next if (($err = run(@steps)) eq "");
+
+    $errors++;
+    print "$0: ERROR: run $r (seed ", $seed + $r, ") failed: $err\n";
+    @steps = shrink(@steps);
+    print "Shrunk to ", scalar(@steps), " steps:\n";
+    print_trace(@steps);
+    last;
+}
+
+printf "%d runs, %d steps, %d checks in %.3f secs (seeds %d-%d)\n",
+    $r + ($r < $nruns), $nsent, $nchecks, time() - $start, $seed, $seed + $r - ($r == $nruns);
+if ($errors) {
+    exit 1;
+}
+print "All runs passed\n";
+exit 0;
@@ -0,0 +1,22 @@
+/*
+ * timescale.h - Scaled seconds for the test helpers
+ *
+ * sdriver.pl -T <scale> sets TSH_TIMESCALE in the environment, so that
+ * a helper asked to spin for <n> seconds takes <n> * <scale> seconds.
+ */
+#include <stdlib.h>
+#include <time.h>
+
+/* tick - Sleep for one second, as scaled */
+static void tick(void)
+{
+    static double scale = -1;
+    struct timespec ts;
+    char *s;
+
+    if (scale < 0)
+	scale = ((s = getenv("TSH_TIMESCALE")) != NULL && atof(s) > 0) ? atof(s) : 1;
+    ts.tv_sec = (time_t) scale;
+    ts.tv_nsec = (long) ((scale - ts.tv_sec) * 1e9);
+    nanosleep(&ts, NULL);
+}
@@ -6,37 +6,88 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
 #include <signal.h>
 #include <sys/wait.h>
 #include <unistd.h>
 #include "jobs.h"     //prototypes for functions that manage the jobs list
 #include "wrappers.h" //prototypes for functions in wrappers.c
+#include "builtins.h" //echo, printf, true, false and sleep
+#include "server.h"   //tsh -S multi-client server mode
+#include "capture.h"  //tsh -c captured background output
+#include "deadline.h" //timeout=DURATION job deadlines
+#include "after.h"    //after ... -- cmd dependent jobs
+#include "snapshot.h" //tsh -m job table in shared memory
+#include "env.h"      //export, unset and $VAR
+#include "wildcard.h" //*, ? and [...] expansion
+#include "perfstat.h" //tsh -e per-job event counters
+#include "reaper.h"   //jobs as whole process trees
 //#include <string>
 
 
 /* Misc manifest constants */
 #define MAXLINE 1024 /* max line size */
-#define MAXARGS 128  /* max args on a command line */
+#define MAXINPUT 65536 /* max command line (a list can be long) */
+#define MAXARGS 128  /* initial room for args (the array grows) */
+
+/* Connectors between the commands of a list */
+#define SEQ 0 /* ; (and the first command) */
+#define AND 1 /* && */
+#define OR  2 /* || */
+
+/* One command of a list */
+typedef struct
+{
+    int op;       /* connector to the command before it */
+    char **argv;  /* its words, NULL-terminated */
+} cmd_t;
+
+/* A builtin, and where it can run */
+#define AS_JOB   1 /* needs nothing of the shell: can run as a job */
+#define JOB_LIST 2 /* needs the shell's job list */
+typedef struct
+{
+    const char *name;
+    builtin_fn *fn;
+    int flags;
+} builtin_t;
+
+/* A command line: commands joined by ;, && and || */
+typedef struct
+{
+    int ncmds;
+    cmd_t *cmds;  /* valid until the next parseline */
+} list_t;
 
 /* Global variables */
 extern char **environ;   /* defined in libc */
 char prompt[] = "tsh> "; /* command line prompt (DO NOT CHANGE) */
 int verbose = 0;         /* if true, print additional output (-v option) */
 char sbuf[MAXLINE];      /* for composing sprintf messages */
+int fg_status;           /* wait status of the last foreground job */
+int builtin_status;      /* exit status of the last builtin */
+static int interrupted;  /* ctrl-c ended the last command run_cmd ran */
 
 /* Here are the prototypes for the functions that you will
  * implement in this file.
  */
 void eval(char *cmdline);
+int run_cmd(char **argv, int bg, char *cmdline, list_t *sub);
+int run_list(list_t *list, int subshell);
+static int exit_code(int status);
+static char **expand_argv(char **argv);
+static const builtin_t *find_builtin(const char *name);
 int builtin_cmd(char **argv);
 void do_bgfg(char **argv);
+void do_jobs(char **argv);
 void waitfg(pid_t pid);
 void sigchld_handler(int sig);
+void update_job(pid_t pid, int status);
 void sigtstp_handler(int sig);
 void sigint_handler(int sig);
 
 /* Routines in this file that are already written */
-int parseline(const char *cmdline, char **argv);
+int parseline(const char *cmdline, list_t *list);
 void sigquit_handler(int sig);
 void usage(void);
 
@@ -47,15 +98,16 @@ void usage(void);
 int main(int argc, char **argv)
 {
     char c;
-    char cmdline[MAXLINE];
+    char cmdline[MAXINPUT];
     int emit_prompt = 1; /* emit prompt (default) */
+    char *sockpath = NULL; /* serve clients on this socket (-S) */
 
     /* Redirect stderr to stdout (so that driver will get all output
      * on the pipe connected to stdout) */
     dup2(1, 2);
 
     /* Parse the command line */
-    while ((c = getopt(argc, argv, "hvp")) != EOF)
+    while ((c = getopt(argc, argv, "hvpcgmeS:")) != EOF)
     {
         switch (c)
         {
@@ -68,6 +120,21 @@ int main(int argc, char **argv)
         case 'p':            /* don't print a prompt */
             emit_prompt = 0; /* handy for automatic testing */
             break;
+        case 'c': /* capture background output (see output builtin) */
+            capturing = 1;
+            break;
+        case 'g': /* reuse recent directory listings for wildcards */
+            globcache = 1;
+            break;
+        case 'm': /* publish the job table for tshtop */
+            snapshot_open();
+            break;
+        case 'e': /* count each job's events (see perfstat builtin) */
+            perf_init();
+            break;
+        case 'S': /* run as a server on a Unix domain socket */
+            sockpath = optarg;
+            break;
         default:
             usage();
         }
@@ -83,9 +150,26 @@ int main(int argc, char **argv)
     /* This one provides a clean way to kill the shell */
     Signal(SIGQUIT, sigquit_handler);
 
+    /* The timer wheel behind job deadlines */
+    Signal(SIGALRM, sigalrm_handler);
+
+    /* Captured jobs tell us about new output */
+    if (capturing)
+        Signal(SIGIO, sigio_handler);
+
     /* Initialize the job list */
     initjobs(jobs);
 
+    /* Orphans of our jobs' processes become our children */
+    reaper_init();
+
+    /* Variables for export, unset and $VAR start as our environment */
+    env_init(environ);
+
+    /* In server mode each client gets its own session instead */
+    if (sockpath != NULL)
+        serve(sockpath, emit_prompt);
+
     /* Execute the shell's read/eval loop */
     while (1)
     {
@@ -96,7 +180,7 @@ int main(int argc, char **argv)
             printf("%s", prompt);
             fflush(stdout);
         }
-        if ((fgets(cmdline, MAXLINE, stdin) == NULL) && ferror(stdin))
+        if ((fgets(cmdline, MAXINPUT, stdin) == NULL) && ferror(stdin))
             app_error("fgets error");
         if (feof(stdin))
         { /* End of file (ctrl-d) */
@@ -129,106 +213,478 @@ int main(int argc, char **argv)
 /*
  * eval - Evaluate the command line that the user has just typed in
  *
- * If the user has requested a built-in command (quit, jobs, bg or fg)
- * then execute it immediately. Otherwise, fork a child process and
+ * A line can be a list of commands joined by ;, && and ||, which is
+ * parsed once and then run one command at a time (see run_list).  A
+ * list with a final & runs as a single background job.
+ */
+void eval(char *cmdline)
+{
+    char buf[MAXINPUT];
+    char **argv;
+    list_t list;
+    int bg;
+
+    strcpy(buf, cmdline);
+    bg = parseline(buf, &list);
+
+    if (list.ncmds == 0)
+    {
+        return;
+    }
+    if (list.ncmds == 1)
+    {
+        if ((argv = expand_argv(list.cmds[0].argv)) != NULL)
+            run_cmd(argv, bg, cmdline, NULL);
+        return;
+    }
+
+    // A list in the background is one job: a forked copy of the shell
+    // runs the list.  So is any list in server mode, where the shell
+    // can't wait between the commands.
+    if (bg || serving)
+    {
+        run_cmd(NULL, bg, cmdline, &list);
+        return;
+    }
+    run_list(&list, 0);
+}
+
+/*
+ * run_cmd - Run one command: a builtin at once, anything else as a job.
+ *    With sub set, the job is instead a forked shell that runs the list
+ *    sub.  Returns the exit status: a foreground job's own (128 plus the
+ *    signal number if a signal killed or stopped it), 0 for a
+ *    background job.
+ *
+ * If the user has requested a built-in command (quit, jobs, bg or fg,
+ * or one of the simple builtins in builtins.c) then execute it
+ * immediately.  A simple builtin run in the background is forked but
+ * not exec'd. Otherwise, fork a child process and
  * run the job in the context of the child. If the job is running in
  * the foreground, wait for it to terminate and then return.  Note:
  * each child process must have a unique process group ID so that our
  * background children don't receive SIGINT (SIGTSTP) from the kernel
  * when we type ctrl-c (ctrl-z) at the keyboard.
  */
-void eval(char *cmdline)
+int run_cmd(char **argv, int bg, char *cmdline, list_t *sub)
 {
-    char *argv[MAXARGS];
-    char buf[MAXLINE];
-
     // int status, i; // compiler say this is unused.
     // sigset_t prev_all; // compiler says this is unused.
     sigset_t mask_all, mask_one, prev_one;
     Sigfillset(&mask_all);
 
-    int bg;
     pid_t pid;
+    builtin_fn *simple = NULL;
+    const builtin_t *b;
+    int slot = -1, wfd;
+    long timeout = -1;
+    int i, len, waiting = 0, nassign = 0;
+    after_t req;
+    char **assign = NULL;
+    char **envp;
+    int gate[2];
 
-    strcpy(buf, cmdline);
-    bg = parseline(buf, argv);
+    interrupted = 0;
+    if (sub != NULL)
+    {
+        goto spawn;
+    }
 
+    // NAME=value words before the command go into its environment,
+    // except timeout=DURATION, which gives the job a deadline
+    for (i = 0; argv[i] != NULL && (len = env_assignment(argv[i])) > 0; i++)
+    {
+        if (len == 7 && !strncmp(argv[i], "timeout", 7))
+        {
+            if ((timeout = parse_duration(argv[i] + 8)) < 0)
+            {
+                printf("%s: invalid duration\n", argv[i]);
+                return 1;
+            }
+        }
+        else
+        {
+            argv[nassign++] = argv[i]; // gathered at the front
+        }
+    }
+    assign = argv;
+    argv += i;
     if (argv[0] == NULL)
     {
-        return;
+        // Just assignments: they set the shell's own variables
+        for (i = 0; i < nassign; i++)
+        {
+            env_set(assign[i], env_assignment(assign[i]));
+        }
+        return 0;
+    }
+
+    // after job ... -- cmd: cmd becomes a Pending job
+    if (!strcmp(argv[0], "after"))
+    {
+        if ((waiting = after_parse(argv, bg, &req)) == 0)
+        {
+            return 1;
+        }
+        for (i = 0; (argv[i] = argv[i + waiting]) != NULL; i++)
+            ;
+    }
+
+    // A simple builtin in the background still gets its own job, but the
+    // child runs it directly instead of exec'ing.  So does one with a
+    // deadline, which only a job can have, and sleep in server mode,
+    // where running it in-process would stall every other session.
+    b = find_builtin(argv[0]);
+    simple = (b != NULL && (b->flags & AS_JOB)) ? b->fn : NULL;
+    if (timeout >= 0 && b != NULL && simple == NULL)
+    {
+        printf("%s: a builtin of the shell cannot have a timeout\n", argv[0]);
+        return 1;
+    }
+    builtin_intr = 0;
+    if (!waiting && (simple == NULL || !(bg || timeout >= 0 || (serving && simple == builtin_sleep))) &&
+        builtin_cmd(argv))
+    {
+        interrupted = builtin_intr;
+        return builtin_status;
     }
 
-    if (!builtin_cmd(argv))
+spawn:
     {
+        fflush(stdout); // or the child would print our buffer again
+
         // Parent process blocks SIGCHLD
         Sigemptyset(&mask_one);
         Sigaddset(&mask_one, SIGCHLD);
         Sigprocmask(SIG_BLOCK, &mask_one, &prev_one);
 
+        // The jobs after waits for can't be reaped while SIGCHLD is blocked
+        if (waiting && after_resolve(&req) < 0)
+        {
+            Sigprocmask(SIG_SETMASK, &prev_one, NULL);
+            return 1;
+        }
+
+        // With -c a background job writes into a capture pipe
+        if (bg && capturing)
+        {
+            slot = capture_open(&wfd);
+        }
+
+        // Built here, so that the array is kept for the next command
+        envp = env_envp();
+
+        // With -e the child waits at the gate until its counters are open
+        if (perfstat)
+        {
+            perf_gate(gate);
+        }
+
         // Spawn a child process
         // This is also the child process logic.
         if ((pid = Fork()) == 0)
         {
+            // A list's shell lets signals to the job's group act on it
+            if (sub != NULL)
+            {
+                Signal(SIGINT, SIG_DFL);
+                Signal(SIGTSTP, SIG_DFL);
+                Signal(SIGCHLD, SIG_DFL);
+                Signal(SIGALRM, SIG_DFL);
+            }
             // Child process restores all signals (for itself).
             Sigprocmask(SIG_SETMASK, &prev_one, NULL);
             setpgid(0, 0);
-            Exec(argv[0], argv, environ);
+            after_child(); // other pending jobs' go pipes
+            if (perfstat)
+            {
+                perf_wait(gate);
+            }
+            if (slot >= 0)
+            {
+                dup2(wfd, STDOUT_FILENO);
+                dup2(wfd, STDERR_FILENO);
+                close(wfd);
+            }
+            if (waiting)
+            {
+                after_wait(&req); // until the jobs it depends on are done
+            }
+            // _exit, since exit would move the offset of the stdin we
+            // share with the shell back to what our stdio buffer read
+            if (sub != NULL)
+            {
+                i = run_list(sub, 1);
+                fflush(stdout);
+                _exit(i);
+            }
+            if (simple != NULL)
+            {
+                i = simple(argv);
+                fflush(stdout);
+                _exit(i);
+            }
+            if (nassign > 0)
+            {
+                envp = env_with(assign, nassign);
+            }
+            Exec(argv[0], argv, envp);
         }
 
         // Parent progress
         // Block all signals, add child to job list, restore all signals (including SIGCHLD).
+        if (slot >= 0)
+        {
+            close(wfd);
+        }
 
         if (!bg)
         {
             // int status; // compiler says that it is unused.
             Sigprocmask(SIG_BLOCK, &mask_all, NULL);
             addjob(jobs, pid, FG, cmdline);
+            if (perfstat)
+            {
+                perf_attach(getjobpid(jobs, pid), gate);
+            }
+            if (timeout >= 0)
+            {
+                deadline_arm(getjobpid(jobs, pid), timeout);
+            }
             Sigprocmask(SIG_SETMASK, &prev_one, NULL);
+            fg_status = 0;
             waitfg(pid);
+            interrupted = WIFSIGNALED(fg_status) && WTERMSIG(fg_status) == SIGINT;
+            return exit_code(fg_status);
         }
         else
         {
             Sigprocmask(SIG_BLOCK, &mask_all, NULL);
-            addjob(jobs, pid, BG, cmdline);
+            addjob(jobs, pid, waiting ? PD : BG, cmdline);
             int jid = pid2jid(pid);
+            if (perfstat)
+            {
+                perf_attach(getjobpid(jobs, pid), gate);
+            }
+            if (waiting)
+            {
+                after_add(&req, jobs, pid, timeout); // armed on release
+            }
+            else if (timeout >= 0)
+            {
+                deadline_arm(getjobpid(jobs, pid), timeout);
+            }
+            if (slot >= 0)
+            {
+                capture_attach(slot, jobs, jid, pid);
+            }
             Sigprocmask(SIG_SETMASK, &prev_one, NULL);
             printf("[%d] (%d) %s", jid, pid, cmdline);
             // do background process
         }
     }
-    return;
+    return 0;
 }
 
 /*
- * builtin_cmd - If the user has typed a built-in command then execute
- *    it immediately.
+ * exit_code - The exit status sh would report for a wait status
  */
-int builtin_cmd(char **argv)
+static int exit_code(int status)
 {
-    if (!strncmp(argv[0], "quit", 4))
+    if (WIFEXITED(status))
+        return WEXITSTATUS(status);
+    if (WIFSIGNALED(status))
+        return 128 + WTERMSIG(status);
+    if (WIFSTOPPED(status))
+        return 128 + WSTOPSIG(status);
+    return 0;
+}
+
+/*
+ * run_step - Run one command of a list in the list's own forked shell.
+ *    Commands are waited for directly, without the job list.
+ */
+static int run_step(char **argv)
+{
+    char **assign = argv, **envp;
+    const builtin_t *b;
+    int i, len, status, nassign = 0;
+    pid_t pid;
+
+    for (i = 0; argv[i] != NULL && (len = env_assignment(argv[i])) > 0; i++)
+    {
+        argv[nassign++] = argv[i];
+    }
+    argv += i;
+    if (argv[0] == NULL)
     {
-        exit(0);
+        for (i = 0; i < nassign; i++)
+        {
+            env_set(assign[i], env_assignment(assign[i]));
+        }
+        return 0;
+    }
+
+    b = find_builtin(argv[0]);
+    if (b != NULL && (b->flags & AS_JOB))
+    {
+        status = b->fn(argv);
+        fflush(stdout);
+        return status;
+    }
+    if ((b != NULL && (b->flags & JOB_LIST)) || (nassign > 0 && !strncmp(assign[0], "timeout=", 8)))
+    {
+        printf("%s: not available in a list run as one job\n", argv[0]);
+        return 1;
+    }
+    if (builtin_cmd(argv))
+    {
+        return builtin_status;
     }
 
-    if (!strncmp(argv[0], "jobs", 4))
+    envp = env_envp();
+    if ((pid = Fork()) == 0)
     {
-        listjobs(jobs);
-        return (1);
+        if (nassign > 0)
+        {
+            envp = env_with(assign, nassign);
+        }
+        Exec(argv[0], argv, envp);
     }
-    if (!strncmp(argv[0], "bg", 2))
+    while (waitpid(pid, &status, 0) < 0)
     {
-        do_bgfg(argv);
-        return (1);
+        if (errno != EINTR)
+            return 1;
     }
-    if (!strncmp(argv[0], "fg", 2))
+    return exit_code(status);
+}
+
+/*
+ * step_line - The command line shown for one command of a list
+ */
+static char *step_line(char **argv)
+{
+    static char line[MAXLINE];
+    size_t len = 0;
+
+    for (; *argv != NULL && len < MAXLINE - 2; argv++)
     {
-        do_bgfg(argv);
-        return (1);
+        len += snprintf(line + len, MAXLINE - 1 - len, "%s%s", *argv, argv[1] ? " " : "");
     }
-    /*
-     * runs builtins, and return 1
-     */
-    return 0; /* not a builtin command */
+    if (len > MAXLINE - 2)
+        len = MAXLINE - 2;
+    line[len++] = '\n';
+    line[len] = '\0';
+    return line;
+}
+
+/*
+ * run_list - Run the commands of a list in order.  A command after &&
+ *    runs only if the one before succeeded (exit status 0), and one
+ *    after || only if it failed; ; runs it regardless.  Interrupting a
+ *    foreground command with ctrl-c ends the whole list.  With subshell
+ *    set, the list is running in its own forked shell (see run_cmd).
+ *    Returns the status of the last command run.
+ */
+int run_list(list_t *list, int subshell)
+{
+    char **argv;
+    int i, status = 0;
+
+    for (i = 0; i < list->ncmds; i++)
+    {
+        if ((list->cmds[i].op == AND && status != 0) ||
+            (list->cmds[i].op == OR && status == 0))
+        {
+            continue;
+        }
+        // Expanded only now, after the commands before it have run
+        if ((argv = expand_argv(list->cmds[i].argv)) == NULL)
+        {
+            status = 1;
+            continue;
+        }
+        if (subshell)
+        {
+            status = run_step(argv);
+            continue;
+        }
+        status = run_cmd(argv, 0, step_line(argv), NULL);
+        if (interrupted)
+        {
+            break;
+        }
+    }
+    return status;
+}
+
+
+/* do_quit - The quit builtin */
+static int do_quit(char **argv)
+{
+    if (serving)
+    {
+        end_session(); // only this client's shell quits
+        return 0;
+    }
+    exit(0);
+}
+
+/* The builtins of the job list, which return nothing */
+static int do_jobs_cmd(char **argv) { do_jobs(argv); return 0; }
+static int do_bgfg_cmd(char **argv) { do_bgfg(argv); return 0; }
+static int do_output_cmd(char **argv) { do_output(argv); return 0; }
+static int do_perfstat_cmd(char **argv) { do_perfstat(argv); return 0; }
+
+/* All the builtins.  Only an AS_JOB one can run in a forked child, as a
+ * job; the others act on the shell itself.  A JOB_LIST one needs the
+ * shell's job list, which a list run as one job does not have.  (after
+ * is taken apart by run_cmd before any lookup.) */
+static const builtin_t builtins[] = {
+    {"quit", do_quit, JOB_LIST},
+    {"jobs", do_jobs_cmd, JOB_LIST},
+    {"bg", do_bgfg_cmd, JOB_LIST},
+    {"fg", do_bgfg_cmd, JOB_LIST},
+    {"output", do_output_cmd, JOB_LIST},
+    {"perfstat", do_perfstat_cmd, JOB_LIST},
+    {"after", NULL, JOB_LIST},
+    {"export", do_export, 0},
+    {"unset", do_unset, 0},
+    {"echo", builtin_echo, AS_JOB},
+    {"printf", builtin_printf, AS_JOB},
+    {"true", builtin_true, AS_JOB},
+    {"false", builtin_false, AS_JOB},
+    {"sleep", builtin_sleep, AS_JOB},
+    {NULL, NULL, 0}
+};
+
+/* find_builtin - The builtin called name, or NULL */
+static const builtin_t *find_builtin(const char *name)
+{
+    int i;
+
+    for (i = 0; builtins[i].name != NULL; i++)
+    {
+        if (!strcmp(name, builtins[i].name))
+            return &builtins[i];
+    }
+    return NULL;
+}
+
+/*
+ * builtin_cmd - If the user has typed a built-in command then execute
+ *    it immediately.
+ */
+int builtin_cmd(char **argv)
+{
+    const builtin_t *b = find_builtin(argv[0]);
+
+    if (b == NULL || b->fn == NULL)
+    {
+        return 0; /* not a builtin command */
+    }
+    builtin_status = b->fn(argv);
+    return (1);
 }
 
 /*
@@ -311,12 +767,18 @@ void do_bgfg(char **argv)
     
 
 
+    // A pending job is started by the jobs it waits for, not by bg or fg.
+    if (job->state == PD) {
+        printf("[%d] (%d) is pending\n", jid, pid);
+        return;
+    }
+
     // Check whether we ran bg or fg
     if (!strncmp(argv[0], "bg", 2)) {
         
         // If the second argument (parameters to bg) begin with '%'...
         
-        Kill(-pid, SIGCONT);
+        reaper_kill(pid, SIGCONT);
         
         /*
         // before you modify the job state, block all signals and restore them afterward.
@@ -326,6 +788,7 @@ void do_bgfg(char **argv)
         // set the state of the job to BG.
         Sigprocmask(SIG_BLOCK, &mask_all, &prev_all);
         job->state = BG;
+        snapshot_update(job);
         Sigprocmask(SIG_SETMASK, &prev_all, NULL);
         
         // print the job number in [], the pid number in (), and the original command line.
@@ -341,14 +804,16 @@ void do_bgfg(char **argv)
         // If job is stopped, continue and set to FG.
         // If job state is BG, set to FG.
         if (job->state == ST) {
-            Kill(-pid, SIGCONT);
+            reaper_kill(pid, SIGCONT);
             Sigprocmask(SIG_BLOCK, &mask_all, &prev_all);
             job->state = FG;
+            snapshot_update(job);
             Sigprocmask(SIG_SETMASK, &prev_all, NULL);
         }
         if (job->state == BG) {
             Sigprocmask(SIG_BLOCK, &mask_all, &prev_all);
             job->state = FG;
+            snapshot_update(job);
             Sigprocmask(SIG_SETMASK, &prev_all, NULL);
         }
 
@@ -358,15 +823,101 @@ void do_bgfg(char **argv)
    return;
 }
 
+/*
+ * do_jobs - Execute the builtin jobs command:
+ *    jobs [-rspl] [%jobid | %jobid-%jobid ...]
+ *
+ * -r and -s list only running or stopped jobs, -p prints just the PIDs
+ * and -l adds the time left before each job's timeout.  Jobs can be
+ * picked by jid or by a range of jids.
+ */
+void do_jobs(char **argv)
+{
+    char want[MAXJOBS + 2];
+    char *p, *q;
+    int i, lo, hi, opts = 0, named = 0, picked = 0;
+
+    memset(want, 0, sizeof(want));
+    for (i = 1; argv[i] != NULL; i++)
+    {
+        if (argv[i][0] == '-' && argv[i][1] != '\0')
+        {
+            for (p = argv[i] + 1; *p; p++)
+            {
+                switch (*p)
+                {
+                    case 'r': opts |= LIST_RUNNING; break;
+                    case 's': opts |= LIST_STOPPED; break;
+                    case 'p': opts |= LIST_PIDS; break;
+                    case 'l': opts |= LIST_TIMES; break;
+                    default:
+                        printf("%s: -%c: invalid option\n", argv[0], *p);
+                        printf("usage: %s [-rspl] [%%jobid | %%jobid-%%jobid ...]\n", argv[0]);
+                        return;
+                }
+            }
+            continue;
+        }
+
+        // %N or %N-%M (the second % is optional)
+        lo = hi = -1;
+        if (argv[i][0] == '%')
+        {
+            lo = hi = strtol(argv[i] + 1, &p, 10);
+            if (p != argv[i] + 1 && *p == '-')
+            {
+                q = p + 1 + (p[1] == '%');
+                hi = strtol(q, &p, 10);
+                if (p == q) hi = -1;
+            }
+        }
+        if (lo < 1 || hi < lo || *p != '\0')
+        {
+            printf("%s: argument must be a %%jobid or %%jobid-%%jobid\n", argv[0]);
+            return;
+        }
+        named = 1;
+        if (lo == hi && getjobjid(jobs, lo) == NULL)
+        {
+            printf("%s: No such job\n", argv[i]);
+            continue;
+        }
+        for (; lo <= hi && lo <= MAXJOBS + 1; lo++)
+            want[lo] = 1;
+        picked = 1;
+    }
+
+    // Only jobs that don't exist were named: nothing to list
+    if (named && !picked)
+        return;
+    listjobs_opt(jobs, opts, picked ? want : NULL);
+}
+
 /*
  * waitfg - Block until process pid is no longer the foreground process
+ *
+ * SIGCHLD is blocked while checking, and sigsuspend unblocks it and
+ * sleeps in one step, so the shell wakes as soon as the job is reaped
+ * and a SIGCHLD can't slip in between the check and the sleep.
  */
 void waitfg(pid_t pid)
 {
+    sigset_t mask_one, prev_one;
+
+    // The server can't block here; it parks the session until the job
+    // is reaped instead (see run_session in server.c).
+    if (serving)
+    {
+        return;
+    }
+    Sigemptyset(&mask_one);
+    Sigaddset(&mask_one, SIGCHLD);
+    Sigprocmask(SIG_BLOCK, &mask_one, &prev_one);
     while (pid == fgpid(jobs))
     {
-        sleep(1);
+        sigsuspend(&prev_one);
     }
+    Sigprocmask(SIG_SETMASK, &prev_one, NULL);
     return;
 }
 
@@ -384,51 +935,92 @@ void waitfg(pid_t pid)
 void sigchld_handler(int sig)
 {
     int status;
-    // int i; // compiler says that this is unused.
     pid_t pid;
+
+    while ((pid = reaper_wait(&status)) > 0)
+    {
+        update_job(pid, status);
+    }
+}
+
+/*
+ * update_job - Update the job list for a child that reaper_wait reported
+ *     as exited, killed or stopped.  Split out of sigchld_handler so
+ *     that server mode (server.c) can share it.
+ */
+void update_job(pid_t pid, int status)
+{
     sigset_t mask_all, prev_all;
+    job_t *job = getjobpid(jobs, reaper_job(pid));
+    int leader = status;
+
+    // Not part of any job of ours (its session may have closed)
+    if (job == NULL)
+    {
+        return;
+    }
     Sigfillset(&mask_all);
 
-    while ((pid = waitpid(-1, &status, (WNOHANG | WUNTRACED))) > 0)
+    if (pid == fgpid(jobs))
     {
-        if (WIFEXITED(status))
+        fg_status = status; // for && and ||
+    }
+
+    // A job is only done when the last process of its tree is (see reaper.c)
+    if (WIFEXITED(status) || WIFSIGNALED(status))
+    {
+        if (WIFSIGNALED(status) && pid == job->pid)
         {
-            Sigprocmask(SIG_BLOCK, &mask_all, &prev_all);
+            printf("Job [%d] (%d) terminated by signal %d\n", job->jid, pid, WTERMSIG(status));
+        }
+        Sigprocmask(SIG_BLOCK, &mask_all, &prev_all);
+        if (reaper_done(job->pid, pid, &leader))
+        {
+            pid = job->pid;
+            after_reaped(pid, leader); // release jobs waiting on this one
             deletejob(jobs, pid);
+        }
+        Sigprocmask(SIG_SETMASK, &prev_all, NULL);
+    }
+    if (WIFSTOPPED(status) && pid != job->pid)
+    {
+        // Once the leader is gone, the rest of the tree stops the job
+        if (reaper_orphaned(job->pid) && job->state != ST)
+        {
+            printf("Job [%d] (%d) stopped by signal %d\n", job->jid, job->pid, WSTOPSIG(status));
+            Sigprocmask(SIG_BLOCK, &mask_all, &prev_all);
+            job->state = ST;
+            snapshot_update(job);
             Sigprocmask(SIG_SETMASK, &prev_all, NULL);
         }
-        if (WIFSIGNALED(status))
+        return;
+    }
+    if (WIFSTOPPED(status))
+    {
+        int jid = pid2jid(pid);
+        // if so, print out a message to indicate the child was stopped.
+        printf("Job [%d] (%d) stopped by signal %d\n", jid, pid, WSTOPSIG(status));
+        /*
+        Change the state of the job in the jobs array to stopped(ST).
+        You can use the WSTOPSIG macro to retrieve the number of the signal that
+        was sent to the child that caused it to stop.
+
+        You can use either the getjobpid or the getjobjid to get a pointer to the job
+        in order to change the state.
+        */
+        if (WSTOPSIG(status))
         {
-            int jid = pid2jid(pid);
-            printf("Job [%d] (%d) terminated by signal %d\n", jid, pid, WTERMSIG(status));
+            job_t *changedState = getjobjid(jobs, jid);
             Sigprocmask(SIG_BLOCK, &mask_all, &prev_all);
-            deletejob(jobs, pid);
+            changedState->state = ST;
+            snapshot_update(changedState);
             Sigprocmask(SIG_SETMASK, &prev_all, NULL);
         }
-        if (WIFSTOPPED(status))
+        else
         {
-            int jid = pid2jid(pid);
-            // if so, print out a message to indicate the child was stopped.
-            printf("Job [%d] (%d) stopped by signal %d\n", jid, pid, WSTOPSIG(status));
-            /*
-            Change the state of the job in the jobs array to stopped(ST).
-            You can use the WSTOPSIG macro to retrieve the number of the signal that
-            was sent to the child that caused it to stop.
-
-            You can use either the getjobpid or the getjobjid to get a pointer to the job
-            in order to change the state.
-            */
-            if (WSTOPSIG(status))
-            {
-                job_t *changedState = getjobjid(jobs, jid);
-                changedState->state = ST;
-            }
-            else
-            {
-                Sigprocmask(SIG_BLOCK, &mask_all, &prev_all);
-                deletejob(jobs, pid);
-                Sigprocmask(SIG_SETMASK, &prev_all, NULL);
-            }
+            Sigprocmask(SIG_BLOCK, &mask_all, &prev_all);
+            deletejob(jobs, pid);
+            Sigprocmask(SIG_SETMASK, &prev_all, NULL);
         }
     }
 }
@@ -443,9 +1035,10 @@ void sigint_handler(int sig)
     pid_t pid = fgpid(jobs);
     if (pid == 0)
     {
+        builtin_intr = 1; // may be a builtin sleep in the foreground
         return;
     }
-    Kill(-pid, SIGINT);
+    reaper_kill(pid, SIGINT); // the job's whole tree
     return;
 }
 
@@ -461,8 +1054,8 @@ void sigtstp_handler(int sig)
     {
         return;
     }
-    // use the negative because it won't kill the children.
-    Kill(-pid, SIGTSTP);
+    // the whole tree, not just the leader (see reaper.c)
+    reaper_kill(pid, SIGTSTP);
     return;
 }
 
@@ -480,66 +1073,255 @@ void sigquit_handler(int sig)
     exit(1);
 }
 
+static char **args;    /* the argv arrays parseline builds */
+static size_t nargs;   /* words in it */
+static size_t maxargs; /* room for */
+static cmd_t *cmds;    /* the commands of the list */
+static char **xargs;   /* the argv array expand_argv builds */
+static size_t nxargs;  /* words in it */
+static size_t maxxargs; /* room for */
+static int maxcmds;    /* room for */
+
+/* addarg - Append a word to the argv array parseline is building */
+static void addarg(char *word)
+{
+    if (nargs + 1 >= maxargs)
+    {
+        maxargs = maxargs ? maxargs * 2 : MAXARGS;
+        if ((args = realloc(args, maxargs * sizeof(char *))) == NULL)
+            unix_error("realloc error");
+    }
+    args[nargs++] = word;
+}
+
+/* addcmd - Start a new command of the list, after connector op */
+static void addcmd(list_t *list, int op)
+{
+    if (list->ncmds == maxcmds)
+    {
+        maxcmds = maxcmds ? maxcmds * 2 : 16;
+        if ((cmds = realloc(cmds, maxcmds * sizeof(cmd_t))) == NULL)
+            unix_error("realloc error");
+        list->cmds = cmds;
+    }
+    cmds[list->ncmds].op = op;
+    cmds[list->ncmds++].argv = NULL; /* set once args stops moving */
+}
+
+/* by_path - qsort order for the paths a wildcard expands to */
+static int by_path(const void *a, const void *b)
+{
+    return strcmp(*(char **) a, *(char **) b);
+}
+
+/* quoted - Whether a word from parseline is a quoted one: an unquoted
+ * word only starts with a quote when no other quote follows it */
+static int quoted(const char *word)
+{
+    size_t len = strlen(word);
+
+    return len >= 2 && word[0] == '\'' && word[len - 1] == '\'';
+}
+
+/* addxarg - Append a word to the argv array expand_argv is building */
+static void addxarg(char *word)
+{
+    if (nxargs + 1 >= maxxargs)
+    {
+        maxxargs = maxxargs ? maxxargs * 2 : MAXARGS;
+        if ((xargs = realloc(xargs, maxxargs * sizeof(char *))) == NULL)
+            unix_error("realloc error");
+    }
+    xargs[nxargs++] = word;
+}
+
 /*
- * parseline - Parse the command line and build the argv array.
+ * expand_argv - The words of one command of a list as it is about to
+ *    run.  A quoted word loses its quotes.  In the others $NAME and
+ *    ${NAME} are replaced by the variable's value, which is split at
+ *    spaces (but never read as connectors), and words with *, ? or
+ *    [...] by the paths they match, sorted; a pattern that matches
+ *    nothing is kept as it is.  Leading NAME=value words are neither
+ *    split nor matched.  The result is valid until the next call;
+ *    NULL if it is too long.
+ */
+static char **expand_argv(char **argv)
+{
+    static char words[2 * MAXINPUT];
+    char *word = words, *next;
+    size_t len, first;
+    int prefix = 1; /* still in the leading assignments */
+
+    nxargs = 0;
+    glob_reset(); /* the previous command's paths */
+    for (; *argv != NULL; argv++)
+    {
+        if (quoted(*argv))
+        {
+            len = strlen(*argv) - 2;
+            if (word + len + 1 > words + sizeof(words))
+                goto toolong;
+            memcpy(word, *argv + 1, len);
+            word[len] = '\0';
+            addxarg(word);
+            word += len + 1;
+            prefix = 0;
+            continue;
+        }
+        if (env_expand(*argv, strlen(*argv), word, words + sizeof(words) - word) < 0)
+            goto toolong;
+        if (prefix && env_assignment(*argv) > 0)
+        {
+            addxarg(word);
+            word += strlen(word) + 1;
+            continue;
+        }
+        prefix = 0;
+
+        /* Split what the variables put in at spaces, then match */
+        for (; *word != '\0'; word = next)
+        {
+            for (next = word; *next != '\0' && *next != ' '; next++)
+                ;
+            if (next == word)
+            {
+                next++;
+                continue;
+            }
+            if (*next == ' ')
+                *next++ = '\0';
+            first = nxargs;
+            if (!has_wildcard(word) || glob_expand(word, addxarg) == 0)
+                addxarg(word);
+            else
+                qsort(xargs + first, nxargs - first, sizeof(char *), by_path);
+        }
+        word++;
+    }
+    addxarg(NULL);
+    return xargs;
+
+toolong:
+    printf("Command line too long\n");
+    return NULL;
+}
+
+/*
+ * parseline - Parse the command line into a list of commands.
  *
- * Characters enclosed in single quotes are treated as a single
- * argument.  Return true if the user has requested a BG job, false if
- * the user has requested a FG job.
+ * Words are separated by spaces, and commands by ;, && and ||, which
+ * need no spaces around them.  Characters enclosed in single quotes
+ * are treated as a single argument, and the word keeps its quotes until
+ * expand_argv.  Words are not expanded here, since an assignment earlier
+ * in the list has to run first.  The list is valid until the next call;
+ * it has no commands if the line was blank or wrong.  Return true if the
+ * user has requested a BG job (a final &), false if the user has
+ * requested a FG job.
  */
-int parseline(const char *cmdline, char **argv)
+int parseline(const char *cmdline, list_t *list)
 {
-    static char array[MAXLINE]; /* holds local copy of command line */
-    char *buf = array;          /* ptr that traverses command line */
-    char *delim;                /* points to first space delimiter */
-    int argc;                   /* number of args */
-    int bg;                     /* background job? */
+    static char array[MAXINPUT];     /* holds local copy of command line */
+    static char words[2 * MAXINPUT]; /* the words, each NUL-terminated */
+    char *buf = array;               /* ptr that traverses command line */
+    char *word = words;              /* where the next word goes */
+    char *end;                       /* of a word */
+    int bg = 0;                      /* background job? */
+    int op;                          /* connector just read */
+    int i;
+    size_t start = 0;                /* first word of the current command */
+    size_t first;                    /* first word of a command's argv */
+
+    nargs = 0;
+    list->ncmds = 0;
+    list->cmds = cmds;
 
     strcpy(buf, cmdline);
     buf[strlen(buf) - 1] = ' '; /* replace trailing '\n' with space */
-    while (*buf && (*buf == ' '))
-        buf++; /* ignore leading spaces */
 
-    /* Build the argv list */
-    argc = 0;
-    if (*buf == '\'')
-    {
-        buf++;
-        delim = strchr(buf, '\'');
-    }
-    else
-    {
-        delim = strchr(buf, ' ');
-    }
-    while (delim)
+    addcmd(list, SEQ);
+    while (1)
     {
-        argv[argc++] = buf;
-        *delim = '\0';
-        buf = delim + 1;
-        while (*buf && (*buf == ' '))
+        while (*buf == ' ')
             buf++; /* ignore spaces */
+        if (*buf == '\0')
+            break;
 
-        if (*buf == '\'')
+        /* A connector ends the command before it */
+        op = -1;
+        if (buf[0] == ';')
+            op = SEQ, buf++;
+        else if (buf[0] == '&' && buf[1] == '&')
+            op = AND, buf += 2;
+        else if (buf[0] == '|' && buf[1] == '|')
+            op = OR, buf += 2;
+        else if (buf[0] == '&')
         {
-            buf++;
-            delim = strchr(buf, '\'');
+            for (buf++; *buf == ' '; buf++)
+                ;
+            if (*buf != '\0' || nargs == start)
+            {
+                printf("syntax error near &\n");
+                goto error;
+            }
+            bg = 1;
+            break;
         }
+        if (op >= 0)
+        {
+            if (nargs == start)
+            {
+                printf("syntax error near %s\n", op == SEQ ? ";" : op == AND ? "&&" : "||");
+                goto error;
+            }
+            addarg(NULL);
+            addcmd(list, op);
+            start = nargs;
+            continue;
+        }
+
+        /* A word: quoted, or up to a space or a connector */
+        if (*buf == '\'' && (end = strchr(buf + 1, '\'')) != NULL)
+            end++;
         else
         {
-            delim = strchr(buf, ' ');
+            for (end = buf; *end != ' ' && *end != ';' && *end != '&' &&
+                            !(end[0] == '|' && end[1] == '|');
+                 end++)
+                ;
         }
+        memcpy(word, buf, end - buf);
+        word[end - buf] = '\0';
+        addarg(word);
+        word += end - buf + 1;
+        buf = end;
     }
-    argv[argc] = NULL;
 
-    if (argc == 0)
-        return 1; /* ignore blank line */
+    /* A final ; ends the line; any other connector needs a command */
+    if (nargs == start)
+    {
+        if (cmds[list->ncmds - 1].op != SEQ)
+        {
+            printf("syntax error near end of line\n");
+            goto error;
+        }
+        list->ncmds--;
+    }
+    if (list->ncmds > 0)
+        addarg(NULL);
 
-    /* should the job run in the background? */
-    if ((bg = (*argv[argc - 1] == '&')) != 0)
+    /* Each command's words follow the NULL ending the one before */
+    for (i = 0, first = 0; i < list->ncmds; i++)
     {
-        argv[--argc] = NULL;
+        cmds[i].argv = args + first;
+        while (args[first++] != NULL)
+            ;
     }
+    list->cmds = cmds;
     return bg;
+
+error:
+    list->ncmds = 0;
+    return 0;
 }
 
 /*
@@ -547,11 +1329,16 @@ int parseline(const char *cmdline, char **argv)
  */
 void usage(void)
 {
-    printf("Usage: shell [-hvp]\n");
+    printf("Usage: shell [-hvpcgme] [-S socket]\n");
     printf("   -h   print this message\n");
     //-v enables verbose
     printf("   -v   print additional diagnostic information\n");
     // the tester uses the -p option
     printf("   -p   do not emit a command prompt\n");
+    printf("   -c   capture background job output (read it with output %%jid)\n");
+    printf("   -g   cache directory listings for wildcard expansion\n");
+    printf("   -m   publish the job table in shared memory (see tshtop)\n");
+    printf("   -e   count each job's CPU events (show them with perfstat %%jid)\n");
+    printf("   -S   serve many clients on the Unix domain socket <socket>\n");
     exit(1);
 }
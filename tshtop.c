@@ -0,0 +1,217 @@
+/*
+ * tshtop.c - Watch the jobs of a shell started with tsh -m
+ *
+ * usage: tshtop [-b] [-d ms] [-n frames] <pid | /name>
+ *    -b   batch mode: print frames one after another, no screen control
+ *    -d   time between frames in milliseconds (default 50)
+ *    -n   stop after this many frames
+ *
+ * The job table is read straight out of the shell's shared memory
+ * segment (see snapshot.h), so watching a shell costs it nothing.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include "jobs.h"
+#include "snapshot.h"
+
+#define MAXTRIES 100000 /* reads of a record before giving up on it */
+
+static struct snap_job rows[SNAP_JOBS];
+
+/*
+ * read_job - Copy a record consistently.  Returns 0 if it is free, and
+ *    -1 if the shell never finished writing it (it died mid-update).
+ */
+static int read_job(const struct snap_job *r, struct snap_job *out)
+{
+    unsigned s1, s2;
+    int tries;
+
+    for (tries = 0; tries < MAXTRIES; tries++)
+    {
+        s1 = __atomic_load_n(&r->seq, __ATOMIC_ACQUIRE);
+        if (s1 & 1)
+        {
+            /* Being written.  The shell may have been preempted
+             * in the middle, so let it run rather than spin. */
+            if (tries % 64 == 63)
+                sched_yield();
+            continue;
+        }
+        memcpy(out, (const void *) r, sizeof(*out));
+        __atomic_thread_fence(__ATOMIC_ACQUIRE); /* copy done before re-reading seq */
+        s2 = __atomic_load_n(&r->seq, __ATOMIC_RELAXED);
+        if (s1 == s2)
+            return out->pid != 0;
+    }
+    return -1;
+}
+
+/* by_start - qsort order for rows: oldest job first */
+static int by_start(const void *a, const void *b)
+{
+    const struct snap_job *x = a, *y = b;
+
+    return (x->start > y->start) - (x->start < y->start);
+}
+
+/* state_name - What jobs would call a state */
+static const char *state_name(int state)
+{
+    switch (state)
+    {
+    case FG: return "Foreground";
+    case BG: return "Running";
+    case ST: return "Stopped";
+    case PD: return "Pending";
+    default: return "?";
+    }
+}
+
+/*
+ * frame - Render one frame of table into buf.  Returns its length.
+ */
+static size_t frame(const struct snap_table *table, char *buf, size_t size, int maxrows)
+{
+    struct timespec now;
+    long long ns;
+    unsigned i, nrecs;
+    int n = 0, torn = 0, count[PD + 1] = {0};
+    size_t len;
+
+    nrecs = __atomic_load_n(&table->nrecs, __ATOMIC_ACQUIRE);
+    if (nrecs > SNAP_JOBS)
+        nrecs = SNAP_JOBS;
+    for (i = 0; i < nrecs; i++)
+    {
+        switch (read_job(&table->job[i], &rows[n]))
+        {
+        case 1:
+            if (rows[n].state > UNDEF && rows[n].state <= PD)
+                count[rows[n].state]++;
+            n++;
+            break;
+        case -1:
+            torn++;
+            break;
+        }
+    }
+    qsort(rows, n, sizeof(rows[0]), by_start);
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    ns = now.tv_sec * 1000000000LL + now.tv_nsec;
+    len = snprintf(buf, size,
+                   "tsh %d: %d jobs, %d running, %d stopped, %d pending, %lu updates",
+                   (int) table->shell, n, count[FG] + count[BG], count[ST], count[PD],
+                   __atomic_load_n(&table->changes, __ATOMIC_RELAXED));
+    if (torn)
+        len += snprintf(buf + len, size - len, ", %d unreadable", torn);
+    len += snprintf(buf + len, size - len, "\n%8s %5s %-10s %10s  %s\n",
+                    "PID", "JID", "STATE", "TIME", "COMMAND");
+
+    for (i = 0; (int) i < n && (maxrows <= 0 || (int) i < maxrows) && len < size; i++)
+        len += snprintf(buf + len, size - len, "%8d %5d %-10s %10.2f  %s\n",
+                        (int) rows[i].pid, rows[i].jid, state_name(rows[i].state),
+                        (ns - rows[i].start) / 1e9, rows[i].cmdline);
+    if ((int) i < n && len < size)
+        len += snprintf(buf + len, size - len, "... %d more\n", n - (int) i);
+    return len < size ? len : size - 1;
+}
+
+/* usage - Print a help message and exit */
+static void usage(char *prog)
+{
+    printf("usage: %s [-b] [-d ms] [-n frames] <pid | /name>\n", prog);
+    exit(1);
+}
+
+int main(int argc, char **argv)
+{
+    static char buf[SNAP_JOBS * 128];
+    const struct snap_table *table;
+    char name[64];
+    struct timespec delay;
+    struct winsize ws;
+    int c, fd, batch = 0, frames = -1, rows;
+    long ms = 50, n;
+    size_t len;
+
+    while ((c = getopt(argc, argv, "bd:n:")) != EOF)
+    {
+        switch (c)
+        {
+        case 'b':
+            batch = 1;
+            break;
+        case 'd':
+            ms = atol(optarg);
+            break;
+        case 'n':
+            frames = atoi(optarg);
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+    if (optind != argc - 1 || ms < 0)
+        usage(argv[0]);
+
+    if (argv[optind][0] == '/')
+        snprintf(name, sizeof(name), "%s", argv[optind]);
+    else
+        snprintf(name, sizeof(name), "%s%s", SNAP_PREFIX, argv[optind]);
+    if ((fd = shm_open(name, O_RDONLY, 0)) < 0)
+    {
+        printf("%s: %s (is the shell running with -m?)\n", name, strerror(errno));
+        exit(1);
+    }
+    table = mmap(NULL, sizeof(struct snap_table), PROT_READ, MAP_SHARED, fd, 0);
+    if (table == MAP_FAILED)
+    {
+        printf("mmap error: %s\n", strerror(errno));
+        exit(1);
+    }
+    close(fd);
+    if (__atomic_load_n(&table->magic, __ATOMIC_ACQUIRE) != SNAP_MAGIC)
+    {
+        printf("%s: not a tsh job table\n", name);
+        exit(1);
+    }
+
+    delay.tv_sec = ms / 1000;
+    delay.tv_nsec = (ms % 1000) * 1000000;
+    for (n = 0; frames < 0 || n < frames; n++)
+    {
+        if (n > 0)
+            nanosleep(&delay, NULL);
+        /* A shell killed outright never clears magic */
+        if (__atomic_load_n(&table->magic, __ATOMIC_ACQUIRE) != SNAP_MAGIC ||
+            (n % 20 == 0 && kill(table->shell, 0) < 0 && errno == ESRCH))
+        {
+            printf("tsh %d has exited\n", (int) table->shell);
+            exit(0);
+        }
+
+        rows = 0;
+        if (!batch && ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) == 0 && ws.ws_row > 3)
+            rows = ws.ws_row - 3;
+        len = 0;
+        if (!batch)
+            len = snprintf(buf, sizeof(buf), "\033[H\033[J");
+        else if (n > 0)
+            buf[len++] = '\n';
+        len += frame(table, buf + len, sizeof(buf) - len, rows);
+        if (write(STDOUT_FILENO, buf, len) < 0)
+            exit(1);
+    }
+    exit(0);
+}
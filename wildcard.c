@@ -0,0 +1,470 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "wrappers.h"
+#include "wildcard.h"
+
+/* A pattern is expanded one path component at a time.  A component
+ * without wildcards is taken as it is; any other is compiled into a
+ * small program of match operations and run against every name in the
+ * directory.  Directories are read with getdents64 into a large buffer,
+ * so even a huge directory takes only a few system calls.
+ *
+ * With -g a listing is kept for a couple of seconds and reused by later
+ * commands as long as the directory's mtime has not changed.  A listing
+ * made within MTIME_SLACK_NS of the directory's last change is never
+ * trusted: the filesystem's coarse timestamps could hide a second change
+ * in the same tick.
+ *
+ * The paths generated for one command live in an arena that glob_reset
+ * frees when the next command is expanded. */
+
+#define DENTS_BUFSIZE  (256 * 1024)
+#define MTIME_SLACK_NS 20000000LL /* 20 ms */
+#define ARENA_CHUNK    (64 * 1024)
+
+/* Match operations */
+#define OP_CHAR 0 /* one given character */
+#define OP_ANY  1 /* ? */
+#define OP_STAR 2 /* * */
+#define OP_SET  3 /* [...] */
+
+typedef struct
+{
+    unsigned char op;
+    unsigned char c;         /* OP_CHAR */
+    unsigned char set[32];   /* OP_SET: bitmap of the characters matched */
+} matchop_t;
+
+typedef struct
+{
+    char *path;              /* directory, "." for the current one */
+    dev_t dev;
+    ino_t ino;
+    struct timespec mtime;   /* of the directory when it was read */
+    long long readat;        /* CLOCK_REALTIME ns when it was read */
+    char *names;             /* the names, back to back, NUL-terminated */
+    size_t *offs;            /* where each name starts in names */
+    unsigned char *types;    /* and its d_type */
+    size_t count;
+    unsigned lastuse;        /* for evicting the least recently used */
+} listing_t;
+
+typedef struct chunk
+{
+    struct chunk *next;
+    size_t used;
+    size_t size;
+    char data[];
+} chunk_t;
+
+int globcache = 0;
+
+static matchop_t prog[PATH_MAX]; /* the compiled component */
+static int nops;
+static listing_t cache[GLOB_CACHE_DIRS];
+static unsigned usecount;
+static chunk_t *arena;
+static void (*addpath)(char *path);
+static int matches;
+
+/*
+ * has_wildcard - True if word has a *, ? or [ that makes it a pattern
+ */
+int has_wildcard(const char *word)
+{
+    return strpbrk(word, "*?[") != NULL;
+}
+
+/* save - Copy len bytes of s into the arena, NUL-terminated */
+static char *save(const char *s, size_t len)
+{
+    chunk_t *c = arena;
+    size_t size;
+
+    if (c == NULL || c->used + len + 1 > c->size)
+    {
+        size = (len + 1 > ARENA_CHUNK) ? len + 1 : ARENA_CHUNK;
+        if ((c = malloc(sizeof(chunk_t) + size)) == NULL)
+            unix_error("malloc error");
+        c->next = arena;
+        c->used = 0;
+        c->size = size;
+        arena = c;
+    }
+    memcpy(c->data + c->used, s, len);
+    c->data[c->used + len] = '\0';
+    c->used += len + 1;
+    return c->data + c->used - len - 1;
+}
+
+/*
+ * glob_reset - Free the paths generated for the previous command
+ */
+void glob_reset(void)
+{
+    chunk_t *c;
+
+    while ((c = arena) != NULL)
+    {
+        arena = c->next;
+        free(c);
+    }
+}
+
+/*
+ * compile - Compile the len-byte pattern component p into prog.
+ *    A [ with no closing ] is an ordinary character.
+ */
+static void compile(const char *p, size_t len)
+{
+    const char *end = p + len, *q;
+    int negate, c;
+
+    for (nops = 0; p < end; nops++)
+    {
+        matchop_t *m = &prog[nops];
+
+        if (*p == '*')
+        {
+            m->op = OP_STAR;
+            while (p < end && *p == '*')
+                p++; /* ** is the same as * */
+            continue;
+        }
+        if (*p == '?')
+        {
+            m->op = OP_ANY;
+            p++;
+            continue;
+        }
+
+        /* The closing ] of a set; a ] right after [ or [! is literal */
+        q = NULL;
+        if (*p == '[')
+        {
+            q = p + 1 + (p[1] == '!' || p[1] == '^');
+            if (q < end && *q == ']')
+                q++;
+            while (q < end && *q != ']')
+                q++;
+            if (q >= end)
+                q = NULL;
+        }
+        if (q == NULL)
+        {
+            m->op = OP_CHAR;
+            m->c = *p++;
+            continue;
+        }
+
+        m->op = OP_SET;
+        memset(m->set, 0, sizeof(m->set));
+        negate = (p[1] == '!' || p[1] == '^');
+        for (p += 1 + negate; p < q; p++)
+        {
+            if (p + 2 < q && p[1] == '-')
+            {
+                for (c = (unsigned char) p[0]; c <= (unsigned char) p[2]; c++)
+                    m->set[c >> 3] |= 1 << (c & 7);
+                p += 2;
+            }
+            else
+                m->set[(unsigned char) *p >> 3] |= 1 << ((unsigned char) *p & 7);
+        }
+        if (negate)
+            for (c = 0; c < 32; c++)
+                m->set[c] = ~m->set[c];
+        m->set[0] &= ~1; /* never NUL */
+        p = q + 1;
+    }
+}
+
+/* step - Does the operation m match the character c? */
+static int step(const matchop_t *m, unsigned char c)
+{
+    switch (m->op)
+    {
+    case OP_CHAR: return m->c == c;
+    case OP_ANY:  return 1;
+    default:      return (m->set[c >> 3] >> (c & 7)) & 1;
+    }
+}
+
+/*
+ * match - Run the compiled component against a name.  On a mismatch
+ *    the most recent * takes one more character and matching resumes
+ *    after it, which finds a match whenever there is one.
+ */
+static int match(const char *s)
+{
+    int pc = 0, star = -1;
+    const char *mark = NULL;
+
+    /* A leading . must be matched explicitly */
+    if (*s == '.' && (nops == 0 || prog[0].op != OP_CHAR || prog[0].c != '.'))
+        return 0;
+    while (*s)
+    {
+        if (pc < nops && prog[pc].op == OP_STAR)
+        {
+            star = ++pc;
+            mark = s;
+            continue;
+        }
+        if (pc < nops && step(&prog[pc], *s))
+        {
+            pc++;
+            s++;
+            continue;
+        }
+        if (star < 0)
+            return 0;
+        pc = star;
+        s = ++mark;
+    }
+    while (pc < nops && prog[pc].op == OP_STAR)
+        pc++;
+    return pc == nops;
+}
+
+/* now_ns - The time, in CLOCK_REALTIME nanoseconds */
+static long long now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/* drop - Empty a listing */
+static void drop(listing_t *l)
+{
+    free(l->path);
+    free(l->names);
+    free(l->offs);
+    free(l->types);
+    memset(l, 0, sizeof(*l));
+}
+
+/*
+ * fill - Read directory fd into l.  Returns -1 on error.
+ */
+static int fill(listing_t *l, int fd)
+{
+    static char *buf;
+    struct dirent64 *d;
+    size_t size = 0, room = 0, cap = 0, len;
+    ssize_t n, pos;
+
+    if (buf == NULL && (buf = malloc(DENTS_BUFSIZE)) == NULL)
+        unix_error("malloc error");
+    while ((n = getdents64(fd, buf, DENTS_BUFSIZE)) > 0)
+    {
+        for (pos = 0; pos < n; pos += d->d_reclen)
+        {
+            d = (struct dirent64 *) (buf + pos);
+            if (!strcmp(d->d_name, ".") || !strcmp(d->d_name, ".."))
+                continue;
+            len = strlen(d->d_name) + 1;
+            if (size + len > room)
+            {
+                room = (room + len) * 2;
+                if ((l->names = realloc(l->names, room)) == NULL)
+                    unix_error("malloc error");
+            }
+            if (l->count == cap)
+            {
+                cap = cap ? cap * 2 : 64;
+                if ((l->offs = realloc(l->offs, cap * sizeof(size_t))) == NULL ||
+                    (l->types = realloc(l->types, cap)) == NULL)
+                    unix_error("malloc error");
+            }
+            memcpy(l->names + size, d->d_name, len);
+            l->offs[l->count] = size;
+            l->types[l->count++] = d->d_type;
+            size += len;
+        }
+    }
+    return (n < 0) ? -1 : 0;
+}
+
+/*
+ * list_dir - The names in directory path, from the cache if -g allows.
+ *    Returns NULL if it can't be read.
+ */
+static listing_t *list_dir(const char *path)
+{
+    static listing_t scratch;
+    listing_t *l = &scratch, *c;
+    struct stat st;
+    long long now, mtime;
+    int fd, i;
+
+    if ((fd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC)) < 0)
+        return NULL;
+    if (globcache)
+    {
+        if (fstat(fd, &st) < 0)
+        {
+            close(fd);
+            return NULL;
+        }
+        now = now_ns();
+        mtime = st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec;
+
+        /* A listing still good, or else the slot to put one in */
+        l = &cache[0];
+        for (i = 0; i < GLOB_CACHE_DIRS; i++)
+        {
+            c = &cache[i];
+            if (c->path != NULL && !strcmp(c->path, path))
+            {
+                if (c->dev == st.st_dev && c->ino == st.st_ino &&
+                    c->mtime.tv_sec == st.st_mtim.tv_sec &&
+                    c->mtime.tv_nsec == st.st_mtim.tv_nsec &&
+                    c->readat - mtime > MTIME_SLACK_NS &&
+                    now - c->readat < GLOB_CACHE_MS * 1000000LL)
+                {
+                    close(fd);
+                    c->lastuse = ++usecount;
+                    return c;
+                }
+                l = c;
+                break;
+            }
+            if (c->lastuse < l->lastuse)
+                l = c;
+        }
+    }
+
+    drop(l);
+    if (fill(l, fd) < 0)
+    {
+        drop(l);
+        close(fd);
+        return NULL;
+    }
+    close(fd);
+    if (globcache)
+    {
+        if ((l->path = strdup(path)) == NULL)
+            unix_error("malloc error");
+        l->dev = st.st_dev;
+        l->ino = st.st_ino;
+        l->mtime = st.st_mtim;
+        l->readat = now;
+        l->lastuse = ++usecount;
+    }
+    return l;
+}
+
+/* is_dir - Can a listed entry be descended into? */
+static int is_dir(const char *path, unsigned char type)
+{
+    struct stat st;
+
+    if (type == DT_DIR)
+        return 1;
+    if (type != DT_LNK && type != DT_UNKNOWN)
+        return 0;
+    return stat(path, &st) == 0 && S_ISDIR(st.st_mode);
+}
+
+/*
+ * expand - Expand the pattern rest below the directory already in path
+ *    (plen bytes, ending in / unless empty), adding every match
+ */
+static void expand(char *path, size_t plen, const char *rest)
+{
+    const char *slash = strchr(rest, '/'), *name;
+    size_t len = slash ? (size_t) (slash - rest) : strlen(rest), nlen, i, ndirs = 0;
+    struct stat st;
+    listing_t *l;
+    char **dirs = NULL;
+
+    if (plen + len + 2 > PATH_MAX)
+        return;
+
+    /* A component with no wildcards is just a name */
+    if (memchr(rest, '*', len) == NULL && memchr(rest, '?', len) == NULL &&
+        memchr(rest, '[', len) == NULL)
+    {
+        memcpy(path + plen, rest, len);
+        if (slash != NULL)
+        {
+            path[plen + len] = '/';
+            expand(path, plen + len + 1, slash + 1);
+        }
+        else
+        {
+            path[plen + len] = '\0';
+            if (lstat(path, &st) == 0)
+            {
+                addpath(save(path, plen + len));
+                matches++;
+            }
+        }
+        return;
+    }
+
+    compile(rest, len);
+    path[plen] = '\0';
+    if ((l = list_dir(plen ? path : ".")) == NULL)
+        return;
+
+    for (i = 0; i < l->count; i++)
+    {
+        name = l->names + l->offs[i];
+        if (!match(name))
+            continue;
+        nlen = strlen(name);
+        if (plen + nlen + 2 > PATH_MAX)
+            continue;
+        memcpy(path + plen, name, nlen + 1);
+        if (slash == NULL)
+        {
+            addpath(save(path, plen + nlen));
+            matches++;
+        }
+        else if (is_dir(path, l->types[i]))
+        {
+            /* Listing below here may evict l, so keep the names first */
+            if ((ndirs & (ndirs - 1)) == 0 &&
+                (dirs = realloc(dirs, (ndirs ? ndirs * 2 : 1) * sizeof(char *))) == NULL)
+                unix_error("malloc error");
+            dirs[ndirs++] = save(name, nlen);
+        }
+    }
+
+    for (i = 0; i < ndirs; i++)
+    {
+        nlen = strlen(dirs[i]);
+        memcpy(path + plen, dirs[i], nlen);
+        path[plen + nlen] = '/';
+        expand(path, plen + nlen + 1, slash + 1);
+    }
+    free(dirs);
+}
+
+/*
+ * glob_expand - Call add with every path that matches pattern, in no
+ *    particular order, and return how many there were.  The paths stay
+ *    valid until glob_reset.
+ */
+int glob_expand(const char *pattern, void (*add)(char *path))
+{
+    char path[PATH_MAX];
+
+    addpath = add;
+    matches = 0;
+    expand(path, 0, pattern);
+    return matches;
+}
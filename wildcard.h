@@ -0,0 +1,11 @@
+/* Pathname expansion of *, ? and [...] in the words of a command.
+ * A word that matches nothing is left as it is. */
+
+#define GLOB_CACHE_DIRS 16   /* directory listings kept with -g */
+#define GLOB_CACHE_MS   2000 /* ... and for at most this long */
+
+extern int globcache; /* true with -g: reuse recent directory listings */
+
+int has_wildcard(const char *word);
+int glob_expand(const char *pattern, void (*add)(char *path));
+void glob_reset(void);
@@ -72,7 +72,8 @@ pid_t Fork(void) {
 void Exec(char *file, char **argv, char **environ) {
     if (execve(file, argv, environ) < 0) {
         printf("%s: Command not found\n", file);
-        exit(0);
+        fflush(stdout);
+        _exit(127); // as sh does, so that && and || see a failure
     }
 }
 